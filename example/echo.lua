@@ -6,9 +6,8 @@ local NCONN = 0
 
 local function close(req)
     -- print('delete request', req.evr, req.evw)
-    if req.evs then
-        req.evs[1]:revert()
-        req.evs[2]:revert()
+    if req.group then
+        req.group:revert()
     end
 
     req.sock:close()
@@ -110,6 +109,7 @@ local function accept(server, m)
     if not ok then
         print('failed to register read event:', err)
         sock:close()
+        return
     end
     -- register write event with edge triger
     ok, err = evs[2]:aswritable(sock:fd(), req, false, true)
@@ -117,7 +117,11 @@ local function accept(server, m)
         evs[1]:revert()
         print('failed to register write event:', err)
         sock:close()
+        return
     end
+    -- revert the events at once when closing the connection
+    req.group = m:group()
+    req.group:add(evs[1], evs[2])
 
     NCONN = NCONN + 1
     -- print('connection', NCONN)
@@ -0,0 +1,145 @@
+/**
+ *  Copyright (C) 2026 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  channel.c
+ *  lua-evm
+ */
+
+#include "evm_event.h"
+
+// number of the messages published at once
+#define EVM_CHANNEL_NBATCH 64
+
+static int send_lua(lua_State *L)
+{
+    evm_chan_t **ch = luaL_checkudata(L, 1, EVM_CHANNEL_MT);
+    int argc        = lua_gettop(L);
+    const char *msgs[EVM_CHANNEL_NBATCH];
+    size_t lens[EVM_CHANNEL_NBATCH];
+    int nsent = 0;
+    int i     = 2;
+
+    lauxh_checkstring(L, 2);
+    while (i <= argc) {
+        int n = 0;
+        int rv;
+
+        for (; n < EVM_CHANNEL_NBATCH && i <= argc; n++, i++) {
+            msgs[n] = lauxh_checklstring(L, i, &lens[n]);
+        }
+        if ((rv = evm_chan_send(*ch, msgs, lens, n)) == -1) {
+            break;
+        }
+        nsent += rv;
+        if (rv < n) {
+            break;
+        }
+    }
+
+    if (nsent) {
+        lua_pushinteger(L, nsent);
+        return 1;
+    }
+
+    // got error
+    lua_pushnil(L);
+    lua_errno_new(L, errno, "send");
+    return 2;
+}
+
+static int stats_lua(lua_State *L)
+{
+    evm_chan_t **ch = luaL_checkudata(L, 1, EVM_CHANNEL_MT);
+    evm_chring_t *r = (*ch)->ring;
+
+    lua_createtable(L, 0, 6);
+    lauxh_pushint2tbl(L, "size", r->mask + 1);
+    lauxh_pushint2tbl(L, "queued", evm_chan_len(r));
+    lauxh_pushint2tbl(L, "sent", (lua_Integer)r->sent);
+    lauxh_pushint2tbl(L, "rung", (lua_Integer)r->rung);
+    lauxh_pushint2tbl(L, "received", (lua_Integer)r->received);
+    lauxh_pushint2tbl(L, "batches", (lua_Integer)r->batches);
+
+    return 1;
+}
+
+static int close_lua(lua_State *L)
+{
+    evm_chan_t **ch = luaL_checkudata(L, 1, EVM_CHANNEL_MT);
+
+    evm_chan_close(*ch);
+
+    return 0;
+}
+
+static int gc_lua(lua_State *L)
+{
+    evm_chan_t **ch = lua_touserdata(L, 1);
+
+    evm_chan_release(*ch);
+
+    return 0;
+}
+
+static int tostring_lua(lua_State *L)
+{
+    return TOSTRING_MT(L, EVM_CHANNEL_MT);
+}
+
+int evm_channel_new_lua(lua_State *L)
+{
+    lua_Integer size = lauxh_optinteger(L, 1, EVM_CHANNEL_SIZE);
+    evm_chan_t **ch  = NULL;
+
+    if (size < EVM_CHANNEL_MINSIZE || size > EVM_CHANNEL_MAXSIZE) {
+        return lauxh_argerror(L, 1, "size value range must be %d to %d",
+                              EVM_CHANNEL_MINSIZE, EVM_CHANNEL_MAXSIZE);
+    }
+
+    ch = lua_newuserdata(L, sizeof(evm_chan_t *));
+    if (!(*ch = evm_chan_new((uint32_t)size))) {
+        lua_pushnil(L);
+        lua_errno_new(L, errno, "channel");
+        return 2;
+    }
+    lauxh_setmetatable(L, EVM_CHANNEL_MT);
+
+    return 1;
+}
+
+LUALIB_API int luaopen_evm_channel(lua_State *L)
+{
+    struct luaL_Reg mmethod[] = {
+        {"__gc",       gc_lua      },
+        {"__tostring", tostring_lua},
+        {NULL,         NULL        }
+    };
+    struct luaL_Reg method[] = {
+        {"send",  send_lua },
+        {"stats", stats_lua},
+        {"close", close_lua},
+        {NULL,    NULL     }
+    };
+
+    evm_define_mt(L, EVM_CHANNEL_MT, mmethod, method);
+
+    return 0;
+}
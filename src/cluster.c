@@ -0,0 +1,538 @@
+/**
+ *  Copyright (C) 2026 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  cluster.c
+ *  lua-evm
+ */
+
+#include "evm_event.h"
+#include <netdb.h>
+#include <stdio.h>
+#if HAVE_SCHED_H
+# include <sched.h>
+#endif
+
+// loop stats sent from the worker to the parent
+typedef struct {
+    int idx;
+    pid_t pid;
+    int nreg;
+    uint64_t nwait;
+    uint64_t nevent;
+} evm_report_t;
+
+typedef struct {
+    pid_t pid;
+    int restarts;
+    evm_report_t report;
+} evm_worker_t;
+
+typedef struct {
+    int nworkers;
+    int stopping;
+    // internal evm to supervise the workers
+    int m;
+    int fn;
+    int cpus;
+    long ncpu;
+    int backlog;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    // stats pipe
+    int rfd;
+    int wfd;
+    evm_worker_t *workers;
+} evm_cluster_t;
+
+static int cluster_listen(evm_cluster_t *c)
+{
+    int fd = socket(c->addr.ss_family, SOCK_STREAM, 0);
+    int on = 1;
+
+    if (fd == -1) {
+        return -1;
+    }
+#if defined(SO_REUSEPORT)
+    // each worker has its own listener of the same address
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == 0 &&
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == 0 &&
+        fcntl(fd, F_SETFD, FD_CLOEXEC) == 0 &&
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0 &&
+        bind(fd, (struct sockaddr *)&c->addr, c->addrlen) == 0 &&
+        listen(fd, c->backlog) == 0) {
+        return fd;
+    }
+#else
+    (void)on;
+    errno = ENOTSUP;
+#endif
+    close(fd);
+
+    return -1;
+}
+
+static void cluster_pincpu(lua_State *L, evm_cluster_t *c, int idx)
+{
+#if HAVE_SCHED_SETAFFINITY
+    if (c->ncpu > 0) {
+        int cpu = (idx - 1) % c->ncpu;
+        cpu_set_t set;
+
+        // pin to the specified cpu
+        if (lauxh_isref(c->cpus)) {
+            lauxh_pushref(L, c->cpus);
+            lua_rawgeti(L, -1, cpu + 1);
+            cpu = (int)lua_tointeger(L, -1);
+            lua_pop(L, 2);
+        }
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+#else
+    (void)L;
+    (void)c;
+    (void)idx;
+#endif
+}
+
+// send the loop stats of the worker to the parent
+static int report_lua(lua_State *L)
+{
+    evm_t *s        = lua_touserdata(L, lua_upvalueindex(1));
+    evm_report_t rp = {
+        .idx    = (int)lua_tointeger(L, lua_upvalueindex(2)),
+        .pid    = getpid(),
+        .nreg   = s->nreg,
+        .nwait  = s->stats.nwait,
+        .nevent = s->stats.nevent,
+    };
+    int fd = (int)lua_tointeger(L, lua_upvalueindex(3));
+
+    // write is atomic since the size is less than PIPE_BUF
+    if (write(fd, &rp, sizeof(rp)) == sizeof(rp)) {
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    lua_pushboolean(L, 0);
+    lua_errno_new(L, errno, "report");
+    return 2;
+}
+
+// run the worker function in the child process
+static void cluster_worker(lua_State *L, evm_cluster_t *c, int idx)
+{
+    int fd = 0;
+
+    close(c->rfd);
+    cluster_pincpu(L, c, idx);
+    if ((fd = cluster_listen(c)) == -1) {
+        fprintf(stderr, "evm.cluster: worker#%d failed to listen: %s\n", idx,
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    // fn(m, fd, idx, report)
+    lauxh_pushref(L, c->fn);
+    if (evm_new_lua(L) != 1) {
+        fprintf(stderr, "evm.cluster: worker#%d failed to create evm: %s\n",
+                idx, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    lua_pushinteger(L, fd);
+    lua_pushinteger(L, idx);
+    lua_pushvalue(L, -3);
+    lua_pushinteger(L, idx);
+    lua_pushinteger(L, c->wfd);
+    lua_pushcclosure(L, report_lua, 3);
+    if (lua_pcall(L, 4, 0, 0) != 0) {
+        fprintf(stderr, "evm.cluster: worker#%d: %s\n", idx,
+                lua_tostring(L, -1));
+        exit(EXIT_FAILURE);
+    }
+    exit(EXIT_SUCCESS);
+}
+
+// fork the worker and watch its exit
+static int cluster_spawn(lua_State *L, evm_cluster_t *c, int idx)
+{
+    int top   = lua_gettop(L);
+    pid_t pid = 0;
+
+    // create event for the exit of the worker
+    lauxh_pushref(L, c->m);
+    lua_getfield(L, -1, "newevent");
+    lua_pushvalue(L, -2);
+    lua_call(L, 1, 1);
+
+    // flush buffers not to be written twice
+    fflush(NULL);
+    if ((pid = fork()) == -1) {
+        lua_settop(L, top);
+        return -1;
+    } else if (pid == 0) {
+        lua_settop(L, top);
+        cluster_worker(L, c, idx);
+    }
+    c->workers[idx - 1].pid = pid;
+
+    // ev:asproc(pid, idx, true)
+    lua_getfield(L, -1, "asproc");
+    lua_pushvalue(L, -2);
+    lua_pushinteger(L, pid);
+    lua_pushinteger(L, idx);
+    lua_pushboolean(L, 1);
+    lua_call(L, 4, 1);
+    if (!lua_toboolean(L, -1)) {
+        // cannot supervise the worker
+        kill(pid, SIGKILL);
+        evm_proc_reap(pid);
+        c->workers[idx - 1].pid = 0;
+        lua_settop(L, top);
+        return -1;
+    }
+    lua_settop(L, top);
+
+    return 0;
+}
+
+// read the loop stats of the workers
+static void cluster_read(evm_cluster_t *c)
+{
+    evm_report_t rp;
+
+    while (read(c->rfd, &rp, sizeof(rp)) == sizeof(rp)) {
+        if (rp.idx > 0 && rp.idx <= c->nworkers &&
+            c->workers[rp.idx - 1].pid == rp.pid) {
+            c->workers[rp.idx - 1].report = rp;
+        }
+    }
+}
+
+static int nalive(evm_cluster_t *c)
+{
+    int n = 0;
+    int i = 0;
+
+    for (; i < c->nworkers; i++) {
+        n += c->workers[i].pid > 0;
+    }
+    return n;
+}
+
+static int wait_lua(lua_State *L)
+{
+    evm_cluster_t *c = luaL_checkudata(L, 1, EVM_CLUSTER_MT);
+    lua_Integer msec = lauxh_optinteger(L, 2, -1);
+
+    lua_settop(L, 1);
+    // m:wait(msec)
+    lauxh_pushref(L, c->m);
+    lua_getfield(L, 2, "wait");
+    lua_pushvalue(L, 2);
+    lua_pushinteger(L, msec);
+    lua_call(L, 2, 2);
+    if (!lua_isnil(L, -1)) {
+        // got error
+        lua_pushnil(L);
+        lua_insert(L, -2);
+        return 2;
+    }
+    lua_settop(L, 2);
+
+    for (;;) {
+        // ev, ctx, disabled, code, signo = m:getevent()
+        lua_getfield(L, 2, "getevent");
+        lua_pushvalue(L, 2);
+        lua_call(L, 1, 5);
+        if (lua_isnil(L, 3)) {
+            break;
+        } else if (lua_isnumber(L, 4)) {
+            // worker exited
+            int idx = (int)lua_tointeger(L, 4);
+
+            // read the last report of the worker before it is forgotten
+            cluster_read(c);
+            c->workers[idx - 1].pid = 0;
+            // restart the crashed worker
+            if (!c->stopping && (!lua_isnumber(L, 6) ||
+                                 lua_tointeger(L, 6) != EXIT_SUCCESS)) {
+                if (cluster_spawn(L, c, idx) == 0) {
+                    c->workers[idx - 1].restarts++;
+                }
+            }
+        } else {
+            cluster_read(c);
+        }
+        lua_settop(L, 2);
+    }
+
+    // returns number of running workers
+    lua_pushinteger(L, nalive(c));
+    return 1;
+}
+
+static void cluster_shutdown(evm_cluster_t *c, int signo)
+{
+    int i = 0;
+
+    // stop restarting and send signal to the workers
+    c->stopping = 1;
+    for (; i < c->nworkers; i++) {
+        if (c->workers[i].pid > 0) {
+            kill(c->workers[i].pid, signo);
+        }
+    }
+}
+
+static int shutdown_lua(lua_State *L)
+{
+    evm_cluster_t *c  = luaL_checkudata(L, 1, EVM_CLUSTER_MT);
+    lua_Integer signo = lauxh_optinteger(L, 2, SIGTERM);
+
+    cluster_shutdown(c, (int)signo);
+
+    return 0;
+}
+
+static int stats_lua(lua_State *L)
+{
+    evm_cluster_t *c = luaL_checkudata(L, 1, EVM_CLUSTER_MT);
+    int i            = 0;
+
+    cluster_read(c);
+    lua_createtable(L, c->nworkers, 0);
+    for (; i < c->nworkers; i++) {
+        evm_worker_t *w = &c->workers[i];
+
+        lua_createtable(L, 0, 6);
+        lauxh_pushint2tbl(L, "pid", w->pid);
+        lauxh_pushint2tbl(L, "restarts", w->restarts);
+        // latest loop stats reported by the worker
+        lauxh_pushint2tbl(L, "nreg", w->report.nreg);
+        lauxh_pushint2tbl(L, "nwait", (lua_Integer)w->report.nwait);
+        lauxh_pushint2tbl(L, "nevent", (lua_Integer)w->report.nevent);
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    return 1;
+}
+
+static int port_lua(lua_State *L)
+{
+    evm_cluster_t *c = luaL_checkudata(L, 1, EVM_CLUSTER_MT);
+
+    if (c->addr.ss_family == AF_INET6) {
+        lua_pushinteger(L,
+                        ntohs(((struct sockaddr_in6 *)&c->addr)->sin6_port));
+    } else {
+        lua_pushinteger(L, ntohs(((struct sockaddr_in *)&c->addr)->sin_port));
+    }
+    return 1;
+}
+
+static int gc_lua(lua_State *L)
+{
+    evm_cluster_t *c = lua_touserdata(L, 1);
+
+    c->m    = lauxh_unref(L, c->m);
+    c->fn   = lauxh_unref(L, c->fn);
+    c->cpus = lauxh_unref(L, c->cpus);
+    if (c->rfd != -1) {
+        close(c->rfd);
+        close(c->wfd);
+        c->rfd = c->wfd = -1;
+    }
+    pdealloc(c->workers);
+
+    return 0;
+}
+
+static int tostring_lua(lua_State *L)
+{
+    return TOSTRING_MT(L, EVM_CLUSTER_MT);
+}
+
+// resolve the listener address and check it can be bound
+static int cluster_resolve(evm_cluster_t *c, const char *host, const char *port)
+{
+    struct addrinfo hints = {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags    = AI_PASSIVE,
+    };
+    struct addrinfo *res = NULL;
+    int fd               = 0;
+    int rc               = getaddrinfo(host, port, &hints, &res);
+
+    if (rc != 0) {
+        errno = (rc == EAI_SYSTEM) ? errno : EINVAL;
+        return -1;
+    }
+    memcpy(&c->addr, res->ai_addr, res->ai_addrlen);
+    c->addrlen = res->ai_addrlen;
+    freeaddrinfo(res);
+
+    if ((fd = cluster_listen(c)) == -1) {
+        return -1;
+    }
+    // fix the ephemeral port for all workers
+    c->addrlen = sizeof(c->addr);
+    getsockname(fd, (struct sockaddr *)&c->addr, &c->addrlen);
+    close(fd);
+
+    return 0;
+}
+
+int evm_cluster_new_lua(lua_State *L)
+{
+    lua_Integer nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    lua_Integer backlog  = SOMAXCONN;
+    const char *host     = NULL;
+    const char *port     = NULL;
+    evm_cluster_t *c     = NULL;
+    int fds[2];
+    int i = 0;
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    lua_settop(L, 2);
+
+    // workers
+    lua_getfield(L, 1, "workers");
+    nworkers = lauxh_optinteger(L, -1, nworkers);
+    if (nworkers < 1 || nworkers > INT_MAX) {
+        return luaL_argerror(L, 1, "workers must be greater than 0");
+    }
+    // backlog
+    lua_getfield(L, 1, "backlog");
+    backlog = lauxh_optinteger(L, -1, backlog);
+    // host and port
+    lua_getfield(L, 1, "host");
+    host = lauxh_optstring(L, -1, NULL);
+    lua_getfield(L, 1, "port");
+    if (!lua_isstring(L, -1)) {
+        return luaL_argerror(L, 1, "port must be a string or an integer");
+    }
+    port = lua_tostring(L, -1);
+    // cpus
+    lua_getfield(L, 1, "cpus");
+
+    c  = lua_newuserdata(L, sizeof(evm_cluster_t));
+    *c = (evm_cluster_t){
+        .nworkers = (int)nworkers,
+        .m        = LUA_NOREF,
+        .fn       = LUA_NOREF,
+        .cpus     = LUA_NOREF,
+        .backlog  = (int)backlog,
+        .rfd      = -1,
+        .wfd      = -1,
+    };
+    if (!(c->workers = pcnalloc((size_t)nworkers, evm_worker_t))) {
+        lua_pushnil(L);
+        lua_errno_new(L, errno, "cluster");
+        return 2;
+    }
+    lauxh_setmetatable(L, EVM_CLUSTER_MT);
+
+    // cpus to pin the workers
+    if (lua_istable(L, -2)) {
+        for (;; c->ncpu++) {
+            lua_rawgeti(L, -2, c->ncpu + 1);
+            if (lua_isnil(L, -1)) {
+                lua_pop(L, 1);
+                break;
+            }
+            lua_pop(L, 1);
+        }
+        lua_pushvalue(L, -2);
+        c->cpus = lauxh_ref(L);
+    } else if (lua_toboolean(L, -2)) {
+        c->ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    lua_pushvalue(L, 2);
+    c->fn = lauxh_ref(L);
+
+    // create listener address, stats pipe and evm to supervise workers
+    if (cluster_resolve(c, host, port) == -1 || pipe(fds) == -1) {
+        lua_pushnil(L);
+        lua_errno_new(L, errno, "cluster");
+        return 2;
+    }
+    c->rfd = fds[0];
+    c->wfd = fds[1];
+    fcntl(c->rfd, F_SETFD, FD_CLOEXEC);
+    fcntl(c->wfd, F_SETFD, FD_CLOEXEC);
+    fcntl(c->rfd, F_SETFL, fcntl(c->rfd, F_GETFL) | O_NONBLOCK);
+    if (evm_new_lua(L) != 1) {
+        return 2;
+    }
+    // m:newevent():asreadable(rfd)
+    lua_getfield(L, -1, "newevent");
+    lua_pushvalue(L, -2);
+    lua_call(L, 1, 1);
+    lua_getfield(L, -1, "asreadable");
+    lua_insert(L, -2);
+    lua_pushinteger(L, c->rfd);
+    lua_call(L, 2, 2);
+    if (!lua_toboolean(L, -2)) {
+        lua_pushnil(L);
+        lua_insert(L, -2);
+        return 2;
+    }
+    lua_pop(L, 2);
+    c->m = lauxh_ref(L);
+
+    // fork workers
+    for (i = 1; i <= c->nworkers; i++) {
+        if (cluster_spawn(L, c, i) == -1) {
+            int err = errno;
+
+            cluster_shutdown(c, SIGTERM);
+            lua_pushnil(L);
+            lua_errno_new(L, err, "cluster");
+            return 2;
+        }
+    }
+
+    return 1;
+}
+
+LUALIB_API int luaopen_evm_cluster(lua_State *L)
+{
+    struct luaL_Reg mmethod[] = {
+        {"__gc",       gc_lua      },
+        {"__tostring", tostring_lua},
+        {NULL,         NULL        }
+    };
+    struct luaL_Reg method[] = {
+        {"wait",     wait_lua    },
+        {"shutdown", shutdown_lua},
+        {"stats",    stats_lua   },
+        {"port",     port_lua    },
+        {NULL,       NULL        }
+    };
+
+    evm_define_mt(L, EVM_CLUSTER_MT, mmethod, method);
+
+    return 0;
+}
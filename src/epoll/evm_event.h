@@ -29,10 +29,315 @@
 #define evm_epoll_event_h
 
 #include "evm.h"
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+
+// inotify read buffer size
+#define EVM_INOTIFY_BUFSIZE (16 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+static inline void evm_init(evm_t *s)
+{
+    s->inotify = (evm_inotify_t){
+        .fd   = -1,
+        .epfd = -1,
+    };
+}
+
+static inline void evm_dealloc(evm_t *s)
+{
+    if (s->inotify.fd != -1) {
+        close(s->inotify.fd);
+    }
+    pdealloc(s->inotify.wds);
+    pdealloc(s->inotify.buf);
+}
+
+// MARK: inotify
+
+static inline uint32_t evm_inotify_mask(int mask)
+{
+    return ((mask & EVM_WATCH_MODIFY) ? IN_MODIFY : 0) |
+           ((mask & EVM_WATCH_ATTRIB) ? IN_ATTRIB : 0) |
+           ((mask & EVM_WATCH_CREATE) ? IN_CREATE : 0) |
+           ((mask & EVM_WATCH_DELETE) ? IN_DELETE : 0) |
+           ((mask & EVM_WATCH_MOVE) ? IN_MOVED_FROM | IN_MOVED_TO : 0) |
+           ((mask & EVM_WATCH_DELETE_SELF) ? IN_DELETE_SELF : 0) |
+           ((mask & EVM_WATCH_MOVE_SELF) ? IN_MOVE_SELF : 0);
+}
+
+static inline int evm_inotify_tomask(uint32_t mask)
+{
+    return ((mask & IN_MODIFY) ? EVM_WATCH_MODIFY : 0) |
+           ((mask & IN_ATTRIB) ? EVM_WATCH_ATTRIB : 0) |
+           ((mask & IN_CREATE) ? EVM_WATCH_CREATE : 0) |
+           ((mask & IN_DELETE) ? EVM_WATCH_DELETE : 0) |
+           ((mask & (IN_MOVED_FROM | IN_MOVED_TO)) ? EVM_WATCH_MOVE : 0) |
+           ((mask & IN_DELETE_SELF) ? EVM_WATCH_DELETE_SELF : 0) |
+           ((mask & IN_MOVE_SELF) ? EVM_WATCH_MOVE_SELF : 0);
+}
+
+// create the inotify instance and register it to the event descriptor
+static inline int evm_inotify_open(evm_t *s)
+{
+    evm_inotify_t *in = &s->inotify;
+
+    if (!in->buf && !(in->buf = pnalloc(EVM_INOTIFY_BUFSIZE, char))) {
+        return -1;
+    } else if (in->fd == -1 &&
+               (in->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+        return -1;
+    } else if (in->epfd != s->fd) {
+        kevt_t evt = {
+            .events = EPOLLIN,
+            .data   = {.fd = in->fd},
+        };
+
+        if (epoll_ctl(s->fd, EPOLL_CTL_ADD, in->fd, &evt) == -1 &&
+            errno != EEXIST) {
+            return -1;
+        }
+        in->epfd = s->fd;
+    }
+
+    return 0;
+}
+
+static inline evm_ev_t *evm_inotify_getwd(evm_inotify_t *in, int wd)
+{
+    if (wd < 0 || wd >= in->nwds) {
+        return NULL;
+    }
+    return in->wds[wd];
+}
+
+static inline int evm_inotify_setwd(evm_inotify_t *in, int wd, evm_ev_t *e)
+{
+    if (wd >= in->nwds) {
+        evm_ev_t **wds = prealloc((size_t)wd + 1, evm_ev_t *, in->wds);
+
+        if (!wds) {
+            return -1;
+        }
+        memset(wds + in->nwds, 0, sizeof(evm_ev_t *) * (wd + 1 - in->nwds));
+        in->nwds = wd + 1;
+        in->wds  = wds;
+    }
+    in->wds[wd] = e;
+
+    return 0;
+}
+
+// add watch of e->path to the inotify instance
+static inline int evm_inotify_add(evm_ev_t *e)
+{
+    evm_t *s = e->s;
+    int wd   = 0;
+
+    if (evm_inotify_open(s) == -1 || evm_increase_evs(s, 1) == -1) {
+        return -1;
+    } else if ((wd = inotify_add_watch(s->inotify.fd, e->path,
+                                       e->reg.events)) == -1) {
+        // path is already watched
+        if (errno == EEXIST) {
+            errno = EALREADY;
+        }
+        return -1;
+    } else if (evm_inotify_getwd(&s->inotify, wd)) {
+        errno = EALREADY;
+        return -1;
+    } else if (evm_inotify_setwd(&s->inotify, wd, e) == -1) {
+        inotify_rm_watch(s->inotify.fd, wd);
+        return -1;
+    }
+
+    e->ident = (uintptr_t)wd;
+    evm_ev_link(e);
+    return 0;
+}
+
+static inline void evm_inotify_del(evm_ev_t *e)
+{
+    evm_inotify_t *in = &e->s->inotify;
+    int wd            = (int)e->ident;
+
+    if (evm_inotify_getwd(in, wd) == e) {
+        in->wds[wd] = NULL;
+        inotify_rm_watch(in->fd, wd);
+    }
+}
+
+// read a batch of inotify events
+static inline void evm_inotify_read(evm_t *s)
+{
+    evm_inotify_t *in = &s->inotify;
+    ssize_t len       = read(in->fd, in->buf, EVM_INOTIFY_BUFSIZE);
+
+    in->pos = 0;
+    in->len = (len > 0) ? len : 0;
+}
+
+// number of the buffered inotify events not delivered yet
+static inline int evm_inotify_nready(evm_t *s)
+{
+    evm_inotify_t *in = &s->inotify;
+    ssize_t pos       = in->pos;
+    int n             = 0;
+
+    while (pos < in->len) {
+        struct inotify_event *ie = (struct inotify_event *)(in->buf + pos);
+
+        pos += sizeof(struct inotify_event) + ie->len;
+        n++;
+    }
+    return n;
+}
+
+// demultiplex the buffered inotify events by watch descriptor
+static inline evm_ev_t *evm_inotify_getev(evm_t *s, int *isdel)
+{
+    evm_inotify_t *in = &s->inotify;
+
+    while (in->pos < in->len) {
+        struct inotify_event *ie = (struct inotify_event *)(in->buf + in->pos);
+        evm_ev_t *e              = evm_inotify_getwd(in, ie->wd);
+
+        in->pos += sizeof(struct inotify_event) + ie->len;
+        // watch has been removed or queue overflowed
+        if (!e) {
+            continue;
+        }
+
+        e->evt.events   = ie->mask;
+        e->evt.data.ptr = ie;
+        // watch is removed by kernel if oneshot or path has gone
+        if ((e->reg.events & IN_ONESHOT) ||
+            (ie->mask & (IN_DELETE_SELF | IN_UNMOUNT | IN_IGNORED))) {
+            *isdel          = 1;
+            in->wds[ie->wd] = NULL;
+        }
+        return e;
+    }
+
+    return NULL;
+}
+
+// MARK: completion queue
+
+// create the completion queue and register its doorbell
+static inline int evm_cq_open(evm_t *s)
+{
+    if (!s->cq && !(s->cq = evm_cq_new())) {
+        return -1;
+    } else if (s->cq->epfd != s->fd) {
+        kevt_t evt = {
+            .events = EPOLLIN,
+            .data   = {.fd = s->cq->db.rfd},
+        };
+
+        if (epoll_ctl(s->fd, EPOLL_CTL_ADD, s->cq->db.rfd, &evt) == -1 &&
+            errno != EEXIST) {
+            return -1;
+        }
+        s->cq->epfd = s->fd;
+    }
+
+    return 0;
+}
+
+// register all the registered events to the renewed event descriptor.
+// returns 0, or the error number of the first failure.
+static inline int evm_reregister(evm_t *s)
+{
+    evm_ev_t *e = s->regs;
+    int err     = 0;
+
+    // internal descriptors of the path watchers and the pool jobs
+    if (s->inotify.fd != -1 && evm_inotify_open(s) == -1) {
+        err = errno;
+    }
+    if (s->cq && evm_cq_open(s) == -1 && !err) {
+        err = errno;
+    }
+
+    for (; e; e = e->next) {
+        switch (e->filter) {
+        case EVFILT_VNODE:
+        case EVFILT_JOB:
+            // delivered via the internal descriptors
+            continue;
+        }
+        if (epoll_ctl(s->fd, EPOLL_CTL_ADD, e->reg.data.fd, &e->reg) == -1 &&
+            !err) {
+            err = errno;
+        }
+    }
+
+    return err;
+}
+
+// wait the events into the specified buffer.
+// timeout is specified in nanoseconds
+static inline int evm_wait_into(evm_t *s, kevt_t *evs, int nevs,
+                                lua_Integer timeout)
+{
+#if defined(HAVE_EPOLL_PWAIT2)
+    struct timespec ts = evm_nsec2timespec(timeout);
+    int nevt =
+        epoll_pwait2(s->fd, evs, nevs, (timeout > -1) ? &ts : NULL, NULL);
+
+    // fallback to epoll_wait if the kernel does not support epoll_pwait2
+    if (nevt != -1 || errno != ENOSYS) {
+        return nevt;
+    }
+#endif
+
+    // round up to milliseconds not to return before the timeout
+    if (timeout > 0) {
+        timeout = (timeout + 999999) / 1000000;
+        if (timeout > INT_MAX) {
+            timeout = INT_MAX;
+        }
+    }
+    return epoll_wait(s->fd, evs, nevs, (int)timeout);
+}
 
 static inline int evm_wait(evm_t *s, lua_Integer timeout)
 {
-    return epoll_wait(s->fd, s->evs, s->nreg, timeout);
+    // the rest of the events are kept in the kernel
+    int nevs = (s->maxevt && s->maxevt < s->nreg) ? s->maxevt : s->nreg;
+
+    return evm_wait_into(s, s->evs, nevs, timeout);
+}
+
+// configure the busy-poll of the network devices for the epoll instance.
+// it is best-effort because it requires linux 6.9 or later.
+static inline void evm_set_busypoll(evm_t *s)
+{
+#if defined(EPIOCSPARAMS)
+    struct epoll_params params = {0};
+
+    if (s->busypoll.max) {
+        params.busy_poll_usecs  = (uint32_t)(s->busypoll.max / 1000);
+        params.busy_poll_budget = 8;
+        params.prefer_busy_poll = 1;
+    }
+    (void)ioctl(s->fd, EPIOCSPARAMS, &params);
+#else
+    (void)s;
+#endif
+}
+
+// get the event object of the kernel event, or NULL if it is internal
+static inline evm_ev_t *evm_kevt_ev(evm_t *s, kevt_t *evt)
+{
+    return (evm_ev_t *)fdismember(&s->fds, evt->data.fd);
+}
+
+// number of the events buffered in user space, that are delivered before the
+// occurred events
+static inline int evm_nbuffered(evm_t *s)
+{
+    return evm_inotify_nready(s) + evm_cq_nready(s->cq);
 }
 
 static inline evm_ev_t *evm_getev(evm_t *s, int *isdel)
@@ -43,8 +348,21 @@ static inline evm_ev_t *evm_getev(evm_t *s, int *isdel)
     int delflg  = 0;
 
 CHECK_NEXT:
-    if (s->nevt > 0) {
+    // deliver the buffered inotify events and completed jobs first
+    if ((e = evm_inotify_getev(s, isdel)) || (e = evm_cq_getev(s, isdel))) {
+        return e;
+    } else if (s->nevt > 0) {
         evt = &s->evs[--s->nevt];
+        // read a batch of events from the shared inotify instance
+        if (evt->data.fd == s->inotify.fd) {
+            evm_inotify_read(s);
+            goto CHECK_NEXT;
+        }
+        // take the completed jobs from the completion queue
+        else if (s->cq && evt->data.fd == s->cq->db.rfd) {
+            evm_cq_take(s->cq);
+            goto CHECK_NEXT;
+        }
         // fetch evm_ev_t from fdset
         if (!(e = (evm_ev_t *)fdismember(&s->fds, evt->data.fd))) {
             goto CHECK_NEXT;
@@ -64,7 +382,16 @@ CHECK_NEXT:
             }
             break;
         case EVFILT_TIMER:
-            (void)read(evt->data.fd, drain, sizeof(uint64_t));
+            // timer has been reset after the expiration
+            if (read(evt->data.fd, &e->nexp, sizeof(uint64_t)) !=
+                sizeof(uint64_t)) {
+                goto CHECK_NEXT;
+            }
+            break;
+        case EVFILT_PROC:
+            // process has exited: reap it and disable the event
+            e->status = evm_proc_reap((pid_t)e->ident);
+            delflg    = EPOLLONESHOT;
             break;
         }
 
@@ -87,7 +414,7 @@ static inline int evm_register(evm_ev_t *e)
         fdset_realloc(&e->s->fds, e->reg.data.fd) == 0 &&
         epoll_ctl(e->s->fd, EPOLL_CTL_ADD, e->reg.data.fd, &e->reg) == 0) {
         fdaddset(&e->s->fds, e->reg.data.fd, (void *)e);
-        e->s->nreg++;
+        evm_ev_link(e);
         return 0;
     }
 
@@ -96,6 +423,21 @@ static inline int evm_register(evm_ev_t *e)
 
 // MARK: API for evm_ev_t
 
+// descriptor of the user watched by the event, or -1 if the event does not
+// watch the descriptor of the user
+static inline int evm_ev_userfd(evm_ev_t *e)
+{
+    switch (e->filter) {
+    case EVFILT_READ:
+    case EVFILT_WRITE:
+    case EVFILT_DGRAM:
+        return (int)e->ident;
+
+    default:
+        return -1;
+    }
+}
+
 static inline int evm_ev_as_fd(evm_ev_t *e, int fd, int oneshot, int edge,
                                int filter)
 {
@@ -142,6 +484,59 @@ static inline int evm_ev_as_writable(evm_ev_t *e, int fd, int oneshot, int edge)
     return evm_ev_as_fd(e, fd, oneshot, edge, EVFILT_WRITE);
 }
 
+static inline int evm_ev_as_datagram(evm_ev_t *e, int fd, int nmsg,
+                                     size_t pktsize, int oneshot, int edge)
+{
+    evm_dgram_t *d = evm_dgram_alloc(fd, nmsg, pktsize);
+
+    if (d) {
+        if (evm_ev_as_fd(e, fd, oneshot, edge, EVFILT_READ) == 0) {
+            e->filter = EVFILT_DGRAM;
+            e->dgram  = d;
+            return 0;
+        }
+        evm_dgram_free(d);
+    }
+
+    return -1;
+}
+
+static inline int evm_ev_as_handoff(evm_ev_t *e, evm_inbox_t *ib)
+{
+    if (evm_ev_as_fd(e, ib->db.rfd, 0, 0, EVFILT_READ) == 0) {
+        e->filter = EVFILT_HANDOFF;
+        e->inbox  = ib;
+        evm_inbox_retain(ib);
+        return 0;
+    }
+
+    return -1;
+}
+
+static inline int evm_ev_as_message(evm_ev_t *e, evm_chan_t *ch)
+{
+    if (evm_ev_as_fd(e, ch->db.rfd, 0, 0, EVFILT_READ) == 0) {
+        e->filter = EVFILT_MESSAGE;
+        e->chan   = ch;
+        evm_chan_retain(ch);
+        return 0;
+    }
+
+    return -1;
+}
+
+static inline int evm_ev_as_loop(evm_ev_t *e, evm_t *child, int nevt)
+{
+    if (evm_ev_as_fd(e, child->fd, 0, 0, EVFILT_READ) == 0) {
+        e->filter  = EVFILT_LOOP;
+        e->loop    = child;
+        e->loopmax = nevt;
+        return 0;
+    }
+
+    return -1;
+}
+
 static inline int evm_ev_as_signal(evm_ev_t *e, int signo, int oneshot)
 {
     // already watched
@@ -176,29 +571,124 @@ static inline int evm_ev_as_signal(evm_ev_t *e, int signo, int oneshot)
     return -1;
 }
 
-static inline int evm_ev_as_timer(evm_ev_t *e, lua_Integer timeout, int oneshot)
+static inline int evm_pidfd_open(pid_t pid)
 {
-    // create timerfd
-    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+#if HAVE_PIDFD_OPEN
+    return pidfd_open(pid, 0);
+#elif defined(SYS_pidfd_open)
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static inline int evm_ev_as_proc(evm_ev_t *e, pid_t pid, int oneshot)
+{
+    // create pidfd that becomes readable when the process exits
+    int fd = evm_pidfd_open(pid);
+
+    if (fd != -1) {
+        // set event fields
+        e->ident       = (uintptr_t)pid;
+        e->filter      = EVFILT_PROC;
+        e->status      = -1;
+        e->reg.data.fd = fd;
+        e->reg.events  = EPOLLIN | (oneshot ? EPOLLONESHOT : 0);
+        // register to evm
+        if (evm_register(e) == 0) {
+            return 0;
+        }
+
+        // close fd
+        close(fd);
+    }
+
+    return -1;
+}
+
+static inline int evm_ev_as_watchpath(evm_ev_t *e, const char *path, int mask,
+                                      int oneshot)
+{
+    // set event fields
+    e->filter      = EVFILT_VNODE;
+    e->reg.data.fd = -1;
+    e->reg.events  = evm_inotify_mask(mask) | (oneshot ? IN_ONESHOT : 0);
+#if defined(IN_MASK_CREATE)
+    // do not replace the mask of the existing watch
+    e->reg.events |= IN_MASK_CREATE;
+#endif
+    if (!(e->path = strdup(path))) {
+        return -1;
+    } else if (evm_inotify_add(e) == 0) {
+        return 0;
+    }
+
+    pdealloc(e->path);
+    e->path = NULL;
+    return -1;
+}
+
+static inline int evm_ev_as_job(evm_ev_t *e, evm_pool_t *p, evm_job_t *job)
+{
+    evm_t *s = e->s;
+
+    if (evm_cq_open(s) == -1 || evm_increase_evs(s, 1) == -1) {
+        return -1;
+    }
+
+    // set event fields
+    e->filter      = EVFILT_JOB;
+    e->ident       = (uintptr_t)job->fd;
+    e->reg.data.fd = -1;
+    job->cq        = s->cq;
+    job->e         = e;
+    evm_cq_retain(s->cq);
+    evm_job_retain(job);
+    if (evm_pool_submit(p, job) == 0) {
+        e->job = job;
+        evm_ev_link(e);
+        return 0;
+    }
+    evm_job_release(job);
+    evm_cq_release(s->cq);
 
-    if (fd) {
-        struct itimerspec its;
+    return -1;
+}
 
-        // convert msec to interval-timespec
-        its.it_interval =
-            (struct timespec){.tv_sec  = (time_t)timeout / 1000,
-                              .tv_nsec = (long)((timeout % 1000) * 1000000)};
-        // set first invocation time
-        its.it_value = its.it_interval;
+// set the period in nanoseconds and the absolute time of the first expiration
+static inline int evm_timer_settime(evm_ev_t *e, lua_Integer nsec,
+                                    struct timespec value)
+{
+    struct itimerspec its = {
+        .it_interval = evm_nsec2timespec(nsec),
+        .it_value    = value,
+    };
 
+    if (timerfd_settime(e->reg.data.fd, TFD_TIMER_ABSTIME, &its, NULL) == 0) {
+        e->nsec = nsec;
+        return 0;
+    }
+    return -1;
+}
+
+static inline int evm_ev_as_timer_at(evm_ev_t *e, lua_Integer nsec,
+                                     int oneshot, struct timespec value)
+{
+    // create timerfd
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (fd != -1) {
         // set event fields
-        e->ident       = (uintptr_t)timeout;
+        e->ident       = 0;
+        e->abstime     = 0;
         e->filter      = EVFILT_TIMER;
         e->reg.data.fd = fd;
         e->reg.events  = EPOLLRDHUP | EPOLLIN | (oneshot ? EPOLLONESHOT : 0);
 
         // set timespec and register to evm
-        if (timerfd_settime(fd, 0, &its, NULL) == 0 && evm_register(e) == 0) {
+        if (evm_timer_settime(e, nsec, value) == 0 && evm_register(e) == 0) {
             return 0;
         }
 
@@ -209,6 +699,127 @@ static inline int evm_ev_as_timer(evm_ev_t *e, lua_Integer timeout, int oneshot)
     return -1;
 }
 
+// timeout is specified in nanoseconds
+static inline int evm_ev_as_timer(evm_ev_t *e, lua_Integer timeout, int oneshot,
+                                  lua_Integer slack, int jitter)
+{
+    // set first invocation time anchored to the cached loop time
+    return evm_ev_as_timer_at(e, timeout, oneshot,
+                              evm_timer_deadline(e->s, timeout, slack, jitter));
+}
+
+// one-shot timer that expires at the absolute time of CLOCK_MONOTONIC.
+// it has no period, and the deadline is kept for ident and reset.
+static inline int evm_ev_as_deadline(evm_ev_t *e, struct timespec deadline)
+{
+    if (evm_ev_as_timer_at(e, 0, 1, deadline) == 0) {
+        e->abstime = evm_timespec2nsec(&deadline);
+        return 0;
+    }
+    return -1;
+}
+
+// period of the timer, or the time until the deadline from the cached loop
+// time
+static inline lua_Integer evm_ev_timer_nsec(evm_ev_t *e)
+{
+    if (e->abstime) {
+        lua_Integer nsec = e->abstime - evm_timespec2nsec(&e->s->clock.mono);
+
+        return (nsec > 0) ? nsec : 1;
+    }
+    return e->nsec;
+}
+
+// re-arm the timer in place with the timeout from the cached loop time
+static inline int evm_ev_reset_timer(evm_ev_t *e, lua_Integer timeout)
+{
+    struct timespec value = evm_timer_deadline(e->s, timeout, 0, 0);
+
+    if (e->abstime) {
+        // move the deadline
+        if (evm_timer_settime(e, 0, value) == -1) {
+            return -1;
+        }
+        e->abstime = evm_timespec2nsec(&value);
+    } else if (evm_timer_settime(e, timeout, value) == -1) {
+        return -1;
+    }
+    // one-shot event is disabled by the expiration until it is modified
+    if (lauxh_isref(e->ref) && (e->reg.events & EPOLLONESHOT)) {
+        return epoll_ctl(e->s->fd, EPOLL_CTL_MOD, e->reg.data.fd, &e->reg);
+    }
+
+    return 0;
+}
+
+// MARK: export and import
+
+// get the attributes of the registered event to export.
+// returns 1 if exportable, 0 if not, or -1 on failure.
+static inline int evm_ev_export(evm_ev_t *e, evm_export_t *rec, int *fd)
+{
+    struct itimerspec its;
+
+    *rec = (evm_export_t){
+        .flags = ((e->reg.events & EPOLLONESHOT) ? EVM_EXPORT_ONESHOT : 0) |
+                 ((e->reg.events & EPOLLET) ? EVM_EXPORT_EDGE : 0),
+    };
+    *fd  = -1;
+    switch (e->filter) {
+    case EVFILT_READ:
+        rec->type = EVM_EXPORT_READABLE;
+        *fd       = e->reg.data.fd;
+        return 1;
+
+    case EVFILT_WRITE:
+        rec->type = EVM_EXPORT_WRITABLE;
+        *fd       = e->reg.data.fd;
+        return 1;
+
+    case EVFILT_DGRAM:
+        rec->type    = EVM_EXPORT_DATAGRAM;
+        rec->nmsg    = (uint16_t)e->dgram->nmsg;
+        rec->pktsize = (uint32_t)e->dgram->pktsize;
+        *fd          = e->reg.data.fd;
+        return 1;
+
+    case EVFILT_TIMER:
+        if (timerfd_gettime(e->reg.data.fd, &its) == -1) {
+            return -1;
+        }
+        rec->type   = EVM_EXPORT_TIMER;
+        rec->ident  = (int64_t)evm_ev_timer_nsec(e);
+        rec->remain = (int64_t)evm_timespec2nsec(&its.it_value);
+        return 1;
+
+    case EVFILT_SIGNAL:
+        rec->type  = EVM_EXPORT_SIGNAL;
+        rec->ident = (int64_t)e->ident;
+        return 1;
+
+    // process-local resources
+    default:
+        return 0;
+    }
+}
+
+// set the remaining time of the imported timer
+static inline int evm_ev_set_remain(evm_ev_t *e, lua_Integer remain)
+{
+    struct itimerspec its = {
+        .it_interval = evm_nsec2timespec(e->nsec),
+        .it_value    = evm_nsec2timespec(remain),
+    };
+
+    // zero value disarms the timer
+    if (remain <= 0) {
+        its.it_value.tv_nsec = 1;
+    }
+
+    return timerfd_settime(e->reg.data.fd, 0, &its, NULL);
+}
+
 static inline int evm_ev_is_oneshot(evm_ev_t *e)
 {
     return e->reg.events & EPOLLONESHOT;
@@ -219,6 +830,126 @@ static inline int evm_ev_is_hup(evm_ev_t *e)
     return e->evt.events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR);
 }
 
+// push the type-specific results of the occurred event
+static inline int evm_ev_pushresult(lua_State *L, evm_ev_t *e)
+{
+    switch (e->filter) {
+    case EVFILT_DGRAM:
+        // receive datagrams into the arena
+        if (evm_dgram_recv(e->dgram, e->reg.data.fd) == -1) {
+            lua_pushinteger(L, 0);
+            lua_errno_new(L, errno, "recv");
+            return 2;
+        }
+        lua_pushinteger(L, e->dgram->nrecv);
+        return 1;
+
+    case EVFILT_TIMER:
+        lua_pushinteger(L, (lua_Integer)e->nexp);
+        return 1;
+
+    case EVFILT_PROC:
+        return evm_proc_pushstatus(L, e->status);
+
+    case EVFILT_JOB:
+        return evm_job_pushresult(L, e->job);
+
+    case EVFILT_HANDOFF:
+        return evm_inbox_pushresult(L, e);
+
+    case EVFILT_MESSAGE:
+        return evm_chan_pushresult(L, e);
+
+    case EVFILT_LOOP:
+        return evm_loop_pushresult(L, e);
+
+    case EVFILT_VNODE: {
+        struct inotify_event *ie = e->evt.data.ptr;
+
+        lua_pushinteger(L, evm_inotify_tomask(ie->mask));
+        // name of the file inside the watched directory
+        if (ie->len) {
+            lua_pushstring(L, ie->name);
+            return 2;
+        }
+        return 1;
+    }
+
+    default:
+        return 0;
+    }
+}
+
+// push the readiness of the occurred event: mask, number of bytes available
+// to read or write, and error
+static inline int evm_ev_revents_lua(lua_State *L, const char *mt)
+{
+    evm_ev_t *e     = luaL_checkudata(L, 1, mt);
+    uint32_t events = e->evt.events;
+
+    lua_pushinteger(L, ((events & EPOLLIN) ? EVM_REV_READ : 0) |
+                           ((events & EPOLLOUT) ? EVM_REV_WRITE : 0) |
+                           ((events & (EPOLLRDHUP | EPOLLHUP)) ? EVM_REV_HUP :
+                                                                 0) |
+                           ((events & EPOLLERR) ? EVM_REV_ERR : 0));
+    // epoll does not report the number of bytes
+    lua_pushnil(L);
+    if (events & EPOLLERR) {
+        int err       = 0;
+        socklen_t len = sizeof(err);
+
+        // get and clear the pending error of the socket
+        if (getsockopt(e->reg.data.fd, SOL_SOCKET, SO_ERROR, &err, &len) ==
+                0 &&
+            err) {
+            lua_errno_new(L, err, "revents");
+            return 3;
+        }
+    }
+
+    return 2;
+}
+
+// set the low-water mark of the socket to signal the readiness.
+// 0 means the default of the system.
+static inline int evm_ev_set_lowat(evm_ev_t *e, int lowat)
+{
+    if (e->filter == EVFILT_READ) {
+        // SO_RCVLOWAT cannot be less than 1
+        if (lowat < 1) {
+            lowat = 1;
+        }
+        return setsockopt(e->reg.data.fd, SOL_SOCKET, SO_RCVLOWAT, &lowat,
+                          sizeof(lowat));
+    }
+#if defined(TCP_NOTSENT_LOWAT)
+    // amount of unsent data in the socket
+    return setsockopt(e->reg.data.fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat,
+                      sizeof(lowat));
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+static inline int evm_ev_lowat_lua(lua_State *L, const char *mt)
+{
+    evm_ev_t *e       = luaL_checkudata(L, 1, mt);
+    lua_Integer lowat = lauxh_checkinteger(L, 2);
+
+    if (lowat < 0 || lowat > INT_MAX) {
+        return luaL_argerror(L, 2,
+                             "lowat value range must be 0 to " MSTRCAT(INT_MAX));
+    } else if (evm_ev_set_lowat(e, (int)lowat) == -1) {
+        lua_pushboolean(L, 0);
+        lua_errno_new(L, errno, "lowat");
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
 static inline int evm_ev_ident_lua(lua_State *L, const char *mt)
 {
     evm_ev_t *e = luaL_checkudata(L, 1, mt);
@@ -266,7 +997,7 @@ static inline int evm_ev_unwatch_lua(lua_State *L, const char *mt,
         fddelset(&e->s->fds, e->reg.data.fd);
         // unregister event
         epoll_ctl(e->s->fd, EPOLL_CTL_DEL, e->reg.data.fd, &evt);
-        e->s->nreg--;
+        evm_ev_unlink(e);
         e->ref = lauxh_unref(L, e->ref);
         if (ev) {
             *ev = e;
@@ -278,6 +1009,24 @@ static inline int evm_ev_unwatch_lua(lua_State *L, const char *mt,
     return 1;
 }
 
+// epoll_ctl changes one descriptor at a time
+static inline int evm_ev_batchable(evm_ev_t *e)
+{
+    (void)e;
+    return 0;
+}
+
+static inline void evm_ev_batch(evm_t *s, evm_ev_t **evs, int n, int watch)
+{
+    int i = 0;
+
+    (void)s;
+    (void)watch;
+    for (; i < n; i++) {
+        evs[i] = NULL;
+    }
+}
+
 // implemented at epoll/common.c
 
 // gc for readable/writable event
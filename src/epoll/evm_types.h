@@ -28,8 +28,15 @@
 #define evm_lua_types_h
 
 #include <sys/epoll.h>
+#include <sys/inotify.h>
 #include <sys/signalfd.h>
 #include <sys/timerfd.h>
+#if HAVE_SYS_PIDFD_H
+# include <sys/pidfd.h>
+#endif
+#if HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 
 // kernel event-loop fd creator
 #if HAVE_EPOLL_CREATE1
@@ -42,15 +49,26 @@
 typedef struct epoll_event kevt_t;
 
 typedef struct evm_st evm_t;
+typedef struct evm_dgram_st evm_dgram_t;
+typedef struct evm_job_st evm_job_t;
+typedef struct evm_inbox_st evm_inbox_t;
+typedef struct evm_chan_st evm_chan_t;
 
 enum {
     EVFILT_READ  = EPOLLIN,
     EVFILT_WRITE = EPOLLOUT,
     EVFILT_TIMER,
-    EVFILT_SIGNAL
+    EVFILT_SIGNAL,
+    EVFILT_DGRAM,
+    EVFILT_PROC,
+    EVFILT_VNODE,
+    EVFILT_JOB,
+    EVFILT_HANDOFF,
+    EVFILT_MESSAGE,
+    EVFILT_LOOP
 };
 
-typedef struct {
+typedef struct evm_ev_st {
     uintptr_t ident;
     evm_t *s;
     kevt_t reg;
@@ -58,8 +76,53 @@ typedef struct {
     int filter;
     int ref;
     int ctx;
+    int status;
+    // number of the timer expirations
+    uint64_t nexp;
+    // period of the timer in nanoseconds
+    lua_Integer nsec;
+    // absolute expiration time of the deadline timer in nanoseconds, or 0
+    lua_Integer abstime;
+    evm_dgram_t *dgram;
+    char *path;
+    evm_job_t *job;
+    evm_inbox_t *inbox;
+    evm_chan_t *chan;
+    // child loop of the loop event, its reference, and the maximum number of
+    // the events to collect from it at once
+    evm_t *loop;
+    int loopref;
+    int loopmax;
+    // deadline of the readable or writable event in nanoseconds
+    lua_Integer deadline;
+    // index in the deadline heap of evm_t, or -1 if not set
+    int didx;
+    // dispatch priority
+    int prio;
+    // list of the registered events of evm_t
+    struct evm_ev_st *prev;
+    struct evm_ev_st *next;
 } evm_ev_t;
 
+// inotify instance shared by all path watchers of evm_t
+#define EVM_USE_INOTIFY 1
+typedef struct {
+    int fd;
+    // event descriptor that the inotify descriptor is registered to
+    int epfd;
+    int nwds;
+    // map watch descriptor to evm_ev_t
+    evm_ev_t **wds;
+    char *buf;
+    ssize_t len;
+    ssize_t pos;
+} evm_inotify_t;
+
+// same source of the kernel events, and merge them
+#define evm_kevt_equal(a, b)     ((a)->data.fd == (b)->data.fd)
+#define evm_kevt_merge(dst, src) ((dst)->events |= (src)->events)
+
 #define evm_ev_filter(e) ((e)->filter)
+#define evm_ev_fd(e)     ((e)->reg.data.fd)
 
 #endif
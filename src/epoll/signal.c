@@ -58,6 +58,11 @@ static int context_lua(lua_State *L)
     return evm_ev_context_lua(L, EVM_SIGNAL_MT);
 }
 
+static int priority_lua(lua_State *L)
+{
+    return evm_ev_priority_lua(L, EVM_SIGNAL_MT);
+}
+
 static int asa_lua(lua_State *L)
 {
     return evm_asa_lua(L, EVM_SIGNAL_MT);
@@ -101,14 +106,15 @@ LUALIB_API int luaopen_evm_signal(lua_State *L)
         {NULL,         NULL         }
     };
     struct luaL_Reg method[] = {
-        {"revert",  revert_lua },
-        {"renew",   renew_lua  },
-        {"ident",   ident_lua  },
-        {"asa",     asa_lua    },
-        {"context", context_lua},
-        {"watch",   watch_lua  },
-        {"unwatch", unwatch_lua},
-        {NULL,      NULL       }
+        {"revert",   revert_lua  },
+        {"renew",    renew_lua   },
+        {"ident",    ident_lua   },
+        {"asa",      asa_lua     },
+        {"context",  context_lua },
+        {"priority", priority_lua},
+        {"watch",    watch_lua   },
+        {"unwatch",  unwatch_lua },
+        {NULL,       NULL        }
     };
 
     evm_define_mt(L, EVM_SIGNAL_MT, mmethod, method);
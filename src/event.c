@@ -32,18 +32,33 @@ typedef int (*fd_initializer)(evm_ev_t *e, int fd, int oneshot, int edge);
 static int asfd_lua(lua_State *L, fd_initializer proc, const char *mt,
                     const char *op)
 {
-    int argc    = lua_gettop(L);
-    evm_ev_t *e = luaL_checkudata(L, 1, EVM_EVENT_MT);
-    int fd      = (int)lauxh_checkinteger(L, 2);
-    int ctx     = LUA_NOREF;
-    int oneshot = 0;
-    int edge    = 0;
+    int argc             = lua_gettop(L);
+    evm_ev_t *e          = luaL_checkudata(L, 1, EVM_EVENT_MT);
+    int fd               = (int)lauxh_checkinteger(L, 2);
+    int ctx              = LUA_NOREF;
+    int oneshot          = 0;
+    int edge             = 0;
+    lua_Integer lowat    = 0;
+    lua_Integer deadline = 0;
 
     // check arguments
-    if (argc > 5) {
-        argc = 5;
+    if (argc > 7) {
+        argc = 7;
     }
     switch (argc) {
+    // arg#7 deadline
+    case 7:
+        deadline = evm_msec2nsec(lauxh_optnumber(L, 7, 0));
+        if (deadline < 0) {
+            return luaL_argerror(L, 7, "deadline must not be less than 0 msec");
+        }
+    // arg#6 low-water mark
+    case 6:
+        lowat = lauxh_optinteger(L, 6, lowat);
+        if (lowat < 0 || lowat > INT_MAX) {
+            return luaL_argerror(
+                L, 6, "lowat value range must be 0 to " MSTRCAT(INT_MAX));
+        }
     // arg#5 edge-trigger (default level-trigger)
     case 5:
         edge = lauxh_optboolean(L, 5, edge);
@@ -71,6 +86,20 @@ static int asfd_lua(lua_State *L, fd_initializer proc, const char *mt,
         // set metatable
         lauxh_setmetatable(L, mt);
         e->ref = lauxh_ref(L);
+        // set low-water mark and deadline
+        if ((lowat && evm_ev_set_lowat(e, (int)lowat) == -1) ||
+            (deadline && evm_deadline_set(e, deadline) == -1)) {
+            int err = errno;
+
+            // revert to the empty event object
+            lauxh_pushref(L, e->ref);
+            lua_getfield(L, -1, "revert");
+            lua_insert(L, -2);
+            lua_call(L, 1, 0);
+            lua_pushboolean(L, 0);
+            lua_errno_new(L, err, op);
+            return 2;
+        }
         lua_pushboolean(L, 1);
         return 1;
     }
@@ -92,6 +121,76 @@ static int asreadable_lua(lua_State *L)
     return asfd_lua(L, evm_ev_as_readable, EVM_READABLE_MT, "asreadable");
 }
 
+static int asdatagram_lua(lua_State *L)
+{
+    int argc            = lua_gettop(L);
+    evm_ev_t *e         = luaL_checkudata(L, 1, EVM_EVENT_MT);
+    int fd              = (int)lauxh_checkinteger(L, 2);
+    int nmsg            = (int)lauxh_optinteger(L, 3, 16);
+    lua_Integer pktsize = EVM_DGRAM_DEFPKTSIZE;
+    int ctx             = LUA_NOREF;
+    int oneshot         = 0;
+    int edge            = 0;
+
+    // check arguments
+    if (argc > 7) {
+        argc = 7;
+    }
+    switch (argc) {
+    // arg#7 payload size of each slot
+    case 7:
+        pktsize = lauxh_optinteger(L, 7, pktsize);
+        if (pktsize < 1 || pktsize > EVM_DGRAM_PKTSIZE) {
+            return lauxh_argerror(L, 7, "pktsize value range must be 1 to %d",
+                                  EVM_DGRAM_PKTSIZE);
+        }
+    // arg#6 edge-trigger (default level-trigger)
+    case 6:
+        edge = lauxh_optboolean(L, 6, edge);
+    case 5:
+        // arg#5 oneshot
+        oneshot = lauxh_optboolean(L, 5, oneshot);
+    case 4:
+        // arg#4 context
+        if (!lua_isnoneornil(L, 4)) {
+            ctx = evm_retain_context(L, 4);
+        }
+    case 3:
+        // arg#3 batch size
+        if (nmsg < 1 || nmsg > EVM_DGRAM_MAXBATCH) {
+            lauxh_unref(L, ctx);
+            return lauxh_argerror(L, 3, "batch value range must be 1 to %d",
+                                  EVM_DGRAM_MAXBATCH);
+        }
+    case 2:
+        // arg#2 descriptor
+        if (fd < 0 || fd > INT_MAX) {
+            lauxh_unref(L, ctx);
+            return luaL_argerror(
+                L, 2, "fd value range must be 0 to " MSTRCAT(INT_MAX));
+        }
+        break;
+    }
+
+    // set datagram-event
+    if (evm_ev_as_datagram(e, fd, nmsg, (size_t)pktsize, oneshot, edge) ==
+        0) {
+        e->ctx = ctx;
+        lua_settop(L, 1);
+        // set datagram metatable
+        lauxh_setmetatable(L, EVM_DATAGRAM_MT);
+        e->ref = lauxh_ref(L);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    // got error
+    lauxh_unref(L, ctx);
+    lua_pushboolean(L, 0);
+    lua_errno_new(L, errno, "asdatagram");
+    return 2;
+}
+
 static int assignal_lua(lua_State *L)
 {
     int argc    = lua_gettop(L);
@@ -140,19 +239,433 @@ static int assignal_lua(lua_State *L)
     return 2;
 }
 
+static int asproc_lua(lua_State *L)
+{
+    int argc        = lua_gettop(L);
+    evm_ev_t *e     = luaL_checkudata(L, 1, EVM_EVENT_MT);
+    lua_Integer pid = lauxh_checkinteger(L, 2);
+    int ctx         = LUA_NOREF;
+    int oneshot     = 0;
+
+    // check arguments
+    if (argc > 4) {
+        argc = 4;
+    }
+    switch (argc) {
+    case 4:
+        // arg#4 oneshot
+        oneshot = lauxh_optboolean(L, 4, oneshot);
+    case 3:
+        // arg#3 context
+        if (!lua_isnoneornil(L, 3)) {
+            ctx = evm_retain_context(L, 3);
+        }
+    case 2:
+        // arg#2 pid
+        if (pid <= 0 || pid > INT_MAX) {
+            lauxh_unref(L, ctx);
+            return luaL_argerror(L, 2, "pid must be greater than 0");
+        }
+        break;
+    }
+
+    // set process-event
+    if (evm_ev_as_proc(e, (pid_t)pid, oneshot) == 0) {
+        e->ctx = ctx;
+        lua_settop(L, 1);
+        // set process metatable
+        lauxh_setmetatable(L, EVM_PROC_MT);
+        e->ref = lauxh_ref(L);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    // got error
+    lauxh_unref(L, ctx);
+    lua_pushboolean(L, 0);
+    lua_errno_new(L, errno, "asproc");
+    return 2;
+}
+
+static int aswatchpath_lua(lua_State *L)
+{
+    int argc         = lua_gettop(L);
+    evm_ev_t *e      = luaL_checkudata(L, 1, EVM_EVENT_MT);
+    const char *path = lauxh_checkstring(L, 2);
+    lua_Integer mask = EVM_WATCH_ALL;
+    int ctx          = LUA_NOREF;
+    int oneshot      = 0;
+
+    // check arguments
+    if (argc > 5) {
+        argc = 5;
+    }
+    switch (argc) {
+    case 5:
+        // arg#5 oneshot
+        oneshot = lauxh_optboolean(L, 5, oneshot);
+    case 4:
+        // arg#4 context
+        if (!lua_isnoneornil(L, 4)) {
+            ctx = evm_retain_context(L, 4);
+        }
+    case 3:
+        // arg#3 mask
+        mask = lauxh_optinteger(L, 3, mask);
+        if (mask <= 0 || mask & ~EVM_WATCH_ALL) {
+            lauxh_unref(L, ctx);
+            return luaL_argerror(L, 3, "mask must be a combination of "
+                                       "evm.WATCH_* constants");
+        }
+        break;
+    }
+
+    // set path-event
+    if (evm_ev_as_watchpath(e, path, (int)mask, oneshot) == 0) {
+        e->ctx = ctx;
+        lua_settop(L, 1);
+        // set watchpath metatable
+        lauxh_setmetatable(L, EVM_WATCHPATH_MT);
+        e->ref = lauxh_ref(L);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    // got error
+    lauxh_unref(L, ctx);
+    lua_pushboolean(L, 0);
+    lua_errno_new(L, errno, "aswatchpath");
+    return 2;
+}
+
+static int ashandoff_lua(lua_State *L)
+{
+    evm_ev_t *e      = luaL_checkudata(L, 1, EVM_EVENT_MT);
+    evm_inbox_t **ib = luaL_checkudata(L, 2, EVM_INBOX_MT);
+    int ctx          = LUA_NOREF;
+
+    // arg#3 context
+    if (!lua_isnoneornil(L, 3)) {
+        ctx = evm_retain_context(L, 3);
+    }
+
+    // set handoff-event
+    if (evm_ev_as_handoff(e, *ib) == 0) {
+        e->ctx = ctx;
+        lua_settop(L, 1);
+        // set handoff metatable
+        lauxh_setmetatable(L, EVM_HANDOFF_MT);
+        e->ref = lauxh_ref(L);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    // got error
+    lauxh_unref(L, ctx);
+    lua_pushboolean(L, 0);
+    lua_errno_new(L, errno, "ashandoff");
+    return 2;
+}
+
+static int asmessage_lua(lua_State *L)
+{
+    evm_ev_t *e     = luaL_checkudata(L, 1, EVM_EVENT_MT);
+    evm_chan_t **ch = luaL_checkudata(L, 2, EVM_CHANNEL_MT);
+    int ctx         = LUA_NOREF;
+
+    // arg#3 context
+    if (!lua_isnoneornil(L, 3)) {
+        ctx = evm_retain_context(L, 3);
+    }
+
+    // set message-event
+    if (evm_ev_as_message(e, *ch) == 0) {
+        e->ctx = ctx;
+        lua_settop(L, 1);
+        // set message metatable
+        lauxh_setmetatable(L, EVM_MESSAGE_MT);
+        e->ref = lauxh_ref(L);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    // got error
+    lauxh_unref(L, ctx);
+    lua_pushboolean(L, 0);
+    lua_errno_new(L, errno, "asmessage");
+    return 2;
+}
+
+static int asloop_lua(lua_State *L)
+{
+    evm_ev_t *e      = luaL_checkudata(L, 1, EVM_EVENT_MT);
+    evm_t *child     = luaL_checkudata(L, 2, EVM_MT);
+    lua_Integer nevt = lauxh_optinteger(L, 4, 0);
+    int ctx          = LUA_NOREF;
+
+    // check arguments
+    if (child == e->s) {
+        return luaL_argerror(L, 2, "cannot watch the loop itself");
+    } else if (nevt < 0 || nevt > INT_MAX) {
+        return lauxh_argerror(L, 4, "nevt value range must be 0 to %d",
+                              INT_MAX);
+    }
+    // arg#3 context
+    if (!lua_isnoneornil(L, 3)) {
+        ctx = evm_retain_context(L, 3);
+    }
+
+    // set loop-event
+    if (evm_ev_as_loop(e, child, (int)nevt) == 0) {
+        e->ctx     = ctx;
+        e->loopref = lauxh_refat(L, 2);
+        lua_settop(L, 1);
+        // set loop metatable
+        lauxh_setmetatable(L, EVM_LOOP_MT);
+        e->ref = lauxh_ref(L);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    // got error
+    lauxh_unref(L, ctx);
+    lua_pushboolean(L, 0);
+    lua_errno_new(L, errno, "asloop");
+    return 2;
+}
+
+static int asjob_lua(lua_State *L, evm_ev_t *e, evm_pool_t *p,
+                     evm_job_t *job, int ctx, const char *op)
+{
+    int err = 0;
+
+    // submit job to the pool
+    if (job && evm_ev_as_job(e, p, job) == 0) {
+        e->ctx = ctx;
+        lua_settop(L, 1);
+        // set job metatable
+        lauxh_setmetatable(L, EVM_JOB_MT);
+        e->ref = lauxh_ref(L);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    // got error
+    err = errno;
+    if (job) {
+        evm_job_release(job);
+    }
+    lauxh_unref(L, ctx);
+    lua_pushboolean(L, 0);
+    lua_errno_new(L, err, op);
+    return 2;
+}
+
+static int asfileread_lua(lua_State *L)
+{
+    int argc           = lua_gettop(L);
+    evm_ev_t *e        = luaL_checkudata(L, 1, EVM_EVENT_MT);
+    evm_pool_t **p     = luaL_checkudata(L, 2, EVM_POOL_MT);
+    lua_Integer fd     = lauxh_checkinteger(L, 3);
+    lua_Integer size   = lauxh_checkinteger(L, 4);
+    lua_Integer offset = -1;
+    int ctx            = LUA_NOREF;
+    evm_job_t *job     = NULL;
+
+    // check arguments
+    if (argc > 6) {
+        argc = 6;
+    }
+    switch (argc) {
+    case 6:
+        // arg#6 context
+        if (!lua_isnoneornil(L, 6)) {
+            ctx = evm_retain_context(L, 6);
+        }
+    case 5:
+        // arg#5 offset
+        offset = lauxh_optinteger(L, 5, offset);
+        if (offset < -1) {
+            lauxh_unref(L, ctx);
+            return luaL_argerror(L, 5, "offset must be greater than or "
+                                       "equal to 0");
+        }
+    default:
+        // arg#3 descriptor
+        if (fd < 0 || fd > INT_MAX) {
+            lauxh_unref(L, ctx);
+            return luaL_argerror(
+                L, 3, "fd value range must be 0 to " MSTRCAT(INT_MAX));
+        }
+        // arg#4 size
+        else if (size < 1 || size > INT_MAX) {
+            lauxh_unref(L, ctx);
+            return luaL_argerror(
+                L, 4, "size value range must be 1 to " MSTRCAT(INT_MAX));
+        }
+        break;
+    }
+
+    if ((job = evm_job_new(EVM_JOB_FILEREAD, (int)fd))) {
+        job->offset = (off_t)offset;
+        job->len    = (size_t)size;
+        if (!(job->buf = pnalloc(job->len, char))) {
+            evm_job_release(job);
+            job = NULL;
+        }
+    }
+
+    return asjob_lua(L, e, *p, job, ctx, "asfileread");
+}
+
+static int asfilewrite_lua(lua_State *L)
+{
+    int argc           = lua_gettop(L);
+    evm_ev_t *e        = luaL_checkudata(L, 1, EVM_EVENT_MT);
+    evm_pool_t **p     = luaL_checkudata(L, 2, EVM_POOL_MT);
+    lua_Integer fd     = lauxh_checkinteger(L, 3);
+    size_t len         = 0;
+    const char *data   = luaL_checklstring(L, 4, &len);
+    lua_Integer offset = -1;
+    int ctx            = LUA_NOREF;
+    evm_job_t *job     = NULL;
+
+    // check arguments
+    if (argc > 6) {
+        argc = 6;
+    }
+    switch (argc) {
+    case 6:
+        // arg#6 context
+        if (!lua_isnoneornil(L, 6)) {
+            ctx = evm_retain_context(L, 6);
+        }
+    case 5:
+        // arg#5 offset
+        offset = lauxh_optinteger(L, 5, offset);
+        if (offset < -1) {
+            lauxh_unref(L, ctx);
+            return luaL_argerror(L, 5, "offset must be greater than or "
+                                       "equal to 0");
+        }
+    default:
+        // arg#3 descriptor
+        if (fd < 0 || fd > INT_MAX) {
+            lauxh_unref(L, ctx);
+            return luaL_argerror(
+                L, 3, "fd value range must be 0 to " MSTRCAT(INT_MAX));
+        }
+        break;
+    }
+
+    // copy data to be written by the worker thread
+    if ((job = evm_job_new(EVM_JOB_FILEWRITE, (int)fd))) {
+        job->offset = (off_t)offset;
+        job->len    = len;
+        if (!(job->buf = pnalloc(len + 1, char))) {
+            evm_job_release(job);
+            job = NULL;
+        } else {
+            memcpy(job->buf, data, len);
+        }
+    }
+
+    return asjob_lua(L, e, *p, job, ctx, "asfilewrite");
+}
+
+static int asfsync_lua(lua_State *L)
+{
+    int argc       = lua_gettop(L);
+    evm_ev_t *e    = luaL_checkudata(L, 1, EVM_EVENT_MT);
+    evm_pool_t **p = luaL_checkudata(L, 2, EVM_POOL_MT);
+    lua_Integer fd = lauxh_checkinteger(L, 3);
+    int ctx        = LUA_NOREF;
+
+    // check arguments
+    if (argc > 4) {
+        argc = 4;
+    }
+    switch (argc) {
+    case 4:
+        // arg#4 context
+        if (!lua_isnoneornil(L, 4)) {
+            ctx = evm_retain_context(L, 4);
+        }
+    default:
+        // arg#3 descriptor
+        if (fd < 0 || fd > INT_MAX) {
+            lauxh_unref(L, ctx);
+            return luaL_argerror(
+                L, 3, "fd value range must be 0 to " MSTRCAT(INT_MAX));
+        }
+        break;
+    }
+
+    return asjob_lua(L, e, *p, evm_job_new(EVM_JOB_FSYNC, (int)fd), ctx,
+                     "asfsync");
+}
+
+static int asgetaddrinfo_lua(lua_State *L)
+{
+    int argc            = lua_gettop(L);
+    evm_ev_t *e         = luaL_checkudata(L, 1, EVM_EVENT_MT);
+    evm_pool_t **p      = luaL_checkudata(L, 2, EVM_POOL_MT);
+    const char *host    = lauxh_checkstring(L, 3);
+    const char *service = NULL;
+    int ctx             = LUA_NOREF;
+    evm_job_t *job      = NULL;
+
+    // check arguments
+    if (argc > 5) {
+        argc = 5;
+    }
+    switch (argc) {
+    case 5:
+        // arg#5 context
+        if (!lua_isnoneornil(L, 5)) {
+            ctx = evm_retain_context(L, 5);
+        }
+    case 4:
+        // arg#4 service
+        service = lauxh_optstring(L, 4, NULL);
+    }
+
+    if ((job = evm_job_new(EVM_JOB_GETADDRINFO, -1))) {
+        if (!(job->host = strdup(host)) ||
+            (service && !(job->service = strdup(service)))) {
+            evm_job_release(job);
+            job = NULL;
+        }
+    }
+
+    return asjob_lua(L, e, *p, job, ctx, "asgetaddrinfo");
+}
+
 static int astimer_lua(lua_State *L)
 {
     int argc            = lua_gettop(L);
     evm_ev_t *e         = luaL_checkudata(L, 1, EVM_EVENT_MT);
-    lua_Integer timeout = lauxh_checkinteger(L, 2);
+    lua_Integer timeout = evm_msec2nsec(lauxh_checknumber(L, 2));
+    lua_Integer slack   = e->s->slack;
     int ctx             = LUA_NOREF;
     int oneshot         = 0;
+    int jitter          = 0;
 
     // check arguments
-    if (argc > 4) {
-        argc = 4;
+    if (argc > 6) {
+        argc = 6;
     }
     switch (argc) {
+    case 6:
+        // arg#6 jitter
+        jitter = lauxh_optboolean(L, 6, jitter);
+    case 5:
+        // arg#5 slack
+        slack = lauxh_optinteger(L, 5, slack);
+        if (slack < 0 || slack > INT_MAX) {
+            return luaL_argerror(
+                L, 5, "slack value range must be 0 to " MSTRCAT(INT_MAX));
+        }
     case 4:
         // arg#4 oneshot
         oneshot = lauxh_optboolean(L, 4, oneshot);
@@ -164,14 +677,13 @@ static int astimer_lua(lua_State *L)
     case 2:
         // arg#2 timeout
         if (timeout <= 0) {
-            return luaL_argerror(
-                L, 2, "timeout must be greater than or equal to 0 msec");
+            return luaL_argerror(L, 2, "timeout must be greater than 0 msec");
         }
         break;
     }
 
     // create timer-event
-    if (evm_ev_as_timer(e, timeout, oneshot) == 0) {
+    if (evm_ev_as_timer(e, timeout, oneshot, slack, jitter) == 0) {
         e->ctx = ctx;
         lua_settop(L, 1);
         // set timer metatable
@@ -188,6 +700,39 @@ static int astimer_lua(lua_State *L)
     return 2;
 }
 
+static int asdeadline_lua(lua_State *L)
+{
+    evm_ev_t *e         = luaL_checkudata(L, 1, EVM_EVENT_MT);
+    lua_Number deadline = lauxh_checknumber(L, 2);
+    lua_Integer nsec    = (lua_Integer)(deadline * 1000000000);
+    int ctx             = LUA_NOREF;
+
+    // check arguments
+    if (nsec <= 0) {
+        return luaL_argerror(L, 2, "deadline must be greater than 0 sec");
+    } else if (!lua_isnoneornil(L, 3)) {
+        // arg#3 context
+        ctx = evm_retain_context(L, 3);
+    }
+
+    // create one-shot timer-event
+    if (evm_ev_as_deadline(e, evm_nsec2timespec(nsec)) == 0) {
+        e->ctx = ctx;
+        lua_settop(L, 1);
+        // set timer metatable
+        lauxh_setmetatable(L, EVM_TIMER_MT);
+        e->ref = lauxh_ref(L);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    // got error
+    lauxh_unref(L, ctx);
+    lua_pushboolean(L, 0);
+    lua_errno_new(L, errno, "asdeadline");
+    return 2;
+}
+
 // common method
 static int renew_lua(lua_State *L)
 {
@@ -219,13 +764,24 @@ LUALIB_API int luaopen_evm_event(lua_State *L)
         {NULL,         NULL        }
     };
     struct luaL_Reg method[] = {
-        {"revert",     revert_lua    },
-        {"renew",      renew_lua     },
-        {"astimer",    astimer_lua   },
-        {"assignal",   assignal_lua  },
-        {"asreadable", asreadable_lua},
-        {"aswritable", aswritable_lua},
-        {NULL,         NULL          }
+        {"revert",        revert_lua       },
+        {"renew",         renew_lua        },
+        {"astimer",       astimer_lua      },
+        {"asdeadline",    asdeadline_lua   },
+        {"assignal",      assignal_lua     },
+        {"asreadable",    asreadable_lua   },
+        {"aswritable",    aswritable_lua   },
+        {"asdatagram",    asdatagram_lua   },
+        {"asproc",        asproc_lua       },
+        {"aswatchpath",   aswatchpath_lua  },
+        {"asfileread",    asfileread_lua   },
+        {"asfilewrite",   asfilewrite_lua  },
+        {"asfsync",       asfsync_lua      },
+        {"asgetaddrinfo", asgetaddrinfo_lua},
+        {"ashandoff",     ashandoff_lua    },
+        {"asmessage",     asmessage_lua    },
+        {"asloop",        asloop_lua       },
+        {NULL,            NULL             }
     };
 
     evm_define_mt(L, EVM_EVENT_MT, mmethod, method);
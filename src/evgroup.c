@@ -0,0 +1,396 @@
+/**
+ *  Copyright (C) 2026 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  evgroup.c
+ *  lua-evm
+ */
+
+#include "evm_event.h"
+
+// event group to revert, pause and resume the member events at once
+typedef struct {
+    evm_t *s;
+    // references of the event monitor and the table of the members
+    int mref;
+    int members;
+    int paused;
+} evm_evgroup_t;
+
+// metatables of the event objects that can join the group
+static const char *const EVM_MEMBER_MT[] = {
+    EVM_READABLE_MT, EVM_WRITABLE_MT, EVM_TIMER_MT,   EVM_SIGNAL_MT,
+    EVM_DATAGRAM_MT, EVM_PROC_MT,     EVM_WATCHPATH_MT,
+    EVM_JOB_MT,      EVM_HANDOFF_MT,  EVM_MESSAGE_MT, EVM_LOOP_MT,
+    NULL,
+};
+
+static int ismember_mt(lua_State *L, int idx)
+{
+    const char *const *mt = EVM_MEMBER_MT;
+
+    if (!lua_getmetatable(L, idx)) {
+        return 0;
+    }
+    for (; *mt; mt++) {
+        luaL_getmetatable(L, *mt);
+        if (lua_rawequal(L, -1, -2)) {
+            lua_pop(L, 2);
+            return 1;
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+// the member has been unregistered by the hangup of the descriptor. whether
+// the descriptor is closed cannot be checked, because its number may be
+// reused by another descriptor.
+static int ishup(evm_ev_t *e)
+{
+    return evm_ev_userfd(e) != -1 && !lauxh_isref(e->ref) &&
+           evm_ev_is_hup(e);
+}
+
+// call the method of the member event at the top of the stack, and leave the
+// error object if failed
+static int call_member(lua_State *L, const char *method)
+{
+    lua_getfield(L, -1, method);
+    lua_pushvalue(L, -2);
+    lua_call(L, 1, 2);
+    if (lua_isboolean(L, -2) && !lua_toboolean(L, -2)) {
+        lua_remove(L, -2);
+        return -1;
+    }
+    lua_pop(L, 2);
+
+    return 0;
+}
+
+// register or unregister the batchable members by a single change of the
+// backend before applying the method to each member. the members that failed
+// to be registered are left to the method to get the error.
+static void batch_members(lua_State *L, evm_evgroup_t *g, int watch, int drop)
+{
+    evm_ev_t **evs = NULL;
+    int n          = 0;
+    int i          = 0;
+
+    lauxh_pushref(L, g->members);
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        lua_pop(L, 1);
+        n++;
+    }
+    if (!n || !(evs = pnalloc((size_t)n, evm_ev_t *))) {
+        lua_pop(L, 1);
+        return;
+    }
+
+    // collect the members to be changed
+    n = 0;
+    lua_newtable(L);
+    lua_pushnil(L);
+    while (lua_next(L, -3)) {
+        evm_ev_t *e = NULL;
+
+        lua_pop(L, 1);
+        if (!ismember_mt(L, -1)) {
+            continue;
+        }
+        e = lua_touserdata(L, -1);
+        if (evm_ev_batchable(e) && lauxh_isref(e->ref) != watch &&
+            !(drop && ishup(e))) {
+            evs[n++] = e;
+            lua_pushvalue(L, -1);
+            lua_rawseti(L, -3, n);
+        }
+    }
+
+    evm_ev_batch(g->s, evs, n, watch);
+    for (; i < n; i++) {
+        if (!evs[i]) {
+            continue;
+        } else if (watch) {
+            // retain event
+            lua_rawgeti(L, -1, i + 1);
+            evs[i]->ref = lauxh_ref(L);
+        } else {
+            evs[i]->ref = lauxh_unref(L, evs[i]->ref);
+        }
+    }
+    pdealloc(evs);
+    lua_pop(L, 2);
+}
+
+// apply the method to all members. the members that are reverted by
+// themselves are removed, and the members whose descriptor has hung up are
+// reverted and removed if drop is true. returns the number of the failures,
+// and leaves the first error object under the members table.
+static int apply_members(lua_State *L, evm_evgroup_t *g, const char *method,
+                         int drop)
+{
+    int nerr = 0;
+
+    if (!strcmp(method, "watch")) {
+        batch_members(L, g, 1, drop);
+    } else if (!strcmp(method, "unwatch") || !strcmp(method, "revert")) {
+        batch_members(L, g, 0, drop);
+    }
+
+    lauxh_pushref(L, g->members);
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        lua_pop(L, 1);
+        if (!ismember_mt(L, -1)) {
+            // reverted by itself
+            lua_pushvalue(L, -1);
+            lua_pushnil(L);
+            lua_rawset(L, -4);
+        } else if (drop && ishup(lua_touserdata(L, -1))) {
+            call_member(L, "revert");
+            lua_pushvalue(L, -1);
+            lua_pushnil(L);
+            lua_rawset(L, -4);
+        } else if (call_member(L, method) != 0) {
+            // keep the first error
+            if (nerr++) {
+                lua_pop(L, 1);
+            } else {
+                lua_insert(L, -3);
+            }
+        }
+    }
+    lua_pop(L, 1);
+
+    return nerr;
+}
+
+static int add_lua(lua_State *L)
+{
+    evm_evgroup_t *g = luaL_checkudata(L, 1, EVM_EVGROUP_MT);
+    int argc         = lua_gettop(L);
+
+    // check arguments
+    for (int i = 2; i <= argc; i++) {
+        if (!ismember_mt(L, i)) {
+            return luaL_argerror(L, i, "event object expected");
+        } else if (((evm_ev_t *)lua_touserdata(L, i))->s != g->s) {
+            return luaL_argerror(L, i,
+                                 "event object of the other event monitor");
+        }
+    }
+
+    lauxh_pushref(L, g->members);
+    for (int i = 2; i <= argc; i++) {
+        lua_pushvalue(L, i);
+        lua_pushboolean(L, 1);
+        lua_rawset(L, -3);
+        if (g->paused) {
+            // member of the paused group is paused
+            lua_pushvalue(L, i);
+            call_member(L, "unwatch");
+            lua_pop(L, 1);
+        }
+    }
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+static int remove_lua(lua_State *L)
+{
+    evm_evgroup_t *g = luaL_checkudata(L, 1, EVM_EVGROUP_MT);
+
+    luaL_checkany(L, 2);
+    lua_settop(L, 2);
+    lauxh_pushref(L, g->members);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+    if (lua_isnil(L, -1)) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    lua_pop(L, 1);
+    lua_pushvalue(L, 2);
+    lua_pushnil(L);
+    lua_rawset(L, -3);
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+static int pause_lua(lua_State *L)
+{
+    evm_evgroup_t *g = luaL_checkudata(L, 1, EVM_EVGROUP_MT);
+
+    lua_settop(L, 1);
+    g->paused = 1;
+    // unwatch does not fail
+    apply_members(L, g, "unwatch", 1);
+    lua_settop(L, 1);
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+static int resume_lua(lua_State *L)
+{
+    evm_evgroup_t *g = luaL_checkudata(L, 1, EVM_EVGROUP_MT);
+
+    lua_settop(L, 1);
+    g->paused = 0;
+    if (apply_members(L, g, "watch", 1)) {
+        // got error
+        lua_pushboolean(L, 0);
+        lua_insert(L, -2);
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+static int revert_lua(lua_State *L)
+{
+    evm_evgroup_t *g = luaL_checkudata(L, 1, EVM_EVGROUP_MT);
+
+    lua_settop(L, 1);
+    apply_members(L, g, "revert", 0);
+    // remove all members
+    lauxh_unref(L, g->members);
+    lua_newtable(L);
+    g->members = lauxh_ref(L);
+    g->paused  = 0;
+
+    return 0;
+}
+
+static int close_lua(lua_State *L)
+{
+    evm_evgroup_t *g = luaL_checkudata(L, 1, EVM_EVGROUP_MT);
+    lua_Integer fd   = lauxh_checkinteger(L, 2);
+
+    if (fd < 0 || fd > INT_MAX) {
+        return luaL_argerror(L, 2,
+                             "fd value range must be 0 to " MSTRCAT(INT_MAX));
+    }
+
+    // revert and remove the members that watch the descriptor before closing
+    // it, so that they are not registered to the reused descriptor number
+    lua_settop(L, 1);
+    lauxh_pushref(L, g->members);
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        lua_pop(L, 1);
+        if (ismember_mt(L, -1) &&
+            evm_ev_userfd(lua_touserdata(L, -1)) == (int)fd) {
+            call_member(L, "revert");
+            lua_pushvalue(L, -1);
+            lua_pushnil(L);
+            lua_rawset(L, -4);
+        }
+    }
+    lua_pop(L, 1);
+
+    if (close((int)fd) == -1) {
+        lua_pushboolean(L, 0);
+        lua_errno_new(L, errno, "close");
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+static int len_lua(lua_State *L)
+{
+    evm_evgroup_t *g = luaL_checkudata(L, 1, EVM_EVGROUP_MT);
+    int n            = 0;
+
+    lauxh_pushref(L, g->members);
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        lua_pop(L, 1);
+        n += ismember_mt(L, -1);
+    }
+    lua_pushinteger(L, n);
+
+    return 1;
+}
+
+static int gc_lua(lua_State *L)
+{
+    evm_evgroup_t *g = lua_touserdata(L, 1);
+
+    // the members are not reverted
+    g->members = lauxh_unref(L, g->members);
+    g->mref    = lauxh_unref(L, g->mref);
+
+    return 0;
+}
+
+static int tostring_lua(lua_State *L)
+{
+    return TOSTRING_MT(L, EVM_EVGROUP_MT);
+}
+
+int evm_evgroup_new_lua(lua_State *L)
+{
+    evm_t *s         = luaL_checkudata(L, 1, EVM_MT);
+    evm_evgroup_t *g = lua_newuserdata(L, sizeof(evm_evgroup_t));
+
+    *g = (evm_evgroup_t){
+        .s       = s,
+        .mref    = lauxh_refat(L, 1),
+        .members = LUA_NOREF,
+    };
+    lua_newtable(L);
+    g->members = lauxh_ref(L);
+    lauxh_setmetatable(L, EVM_EVGROUP_MT);
+
+    return 1;
+}
+
+LUALIB_API int luaopen_evm_evgroup(lua_State *L)
+{
+    struct luaL_Reg mmethod[] = {
+        {"__gc",       gc_lua      },
+        {"__tostring", tostring_lua},
+        {"__len",      len_lua     },
+        {NULL,         NULL        }
+    };
+    struct luaL_Reg method[] = {
+        {"add",    add_lua   },
+        {"remove", remove_lua},
+        {"pause",  pause_lua },
+        {"resume", resume_lua},
+        {"revert", revert_lua},
+        {"close",  close_lua },
+        {NULL,     NULL      }
+    };
+
+    evm_define_mt(L, EVM_EVGROUP_MT, mmethod, method);
+
+    return 0;
+}
@@ -26,39 +26,538 @@
 
 #include "evm_event.h"
 
-static pid_t EVM_PID   = -1;
-static int DEFAULT_EVM = LUA_NOREF;
+// default evm is created for each loop thread
+static __thread pid_t EVM_PID   = -1;
+static __thread int DEFAULT_EVM = LUA_NOREF;
+
+static inline lua_Integer monotonic_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return evm_timespec2nsec(&ts);
+}
+
+// update the moving average of the time until the events occur
+static inline void busypoll_update(evm_busypoll_t *bp, lua_Integer elapsed)
+{
+    bp->avg += (elapsed - bp->avg) / 8;
+}
+
+// spin with zero-timeout waits before blocking. the budget is twice the
+// average time until the events occur, and the spin is skipped if the
+// events occur less frequently than the maximum budget.
+static int busywait(evm_t *s, lua_Integer timeout)
+{
+    evm_busypoll_t *bp = &s->busypoll;
+    lua_Integer budget = 0;
+    lua_Integer start  = 0;
+    lua_Integer spent  = 0;
+    int nevt           = 0;
+
+    if (!bp->max || !timeout) {
+        return evm_wait(s, timeout);
+    } else if (bp->avg <= bp->max) {
+        budget = bp->avg * 2;
+        if (budget > bp->max) {
+            budget = bp->max;
+        } else if (budget < bp->max / 4) {
+            budget = bp->max / 4;
+        }
+        if (timeout > 0 && budget > timeout) {
+            budget = timeout;
+        }
+    }
+
+    start = monotonic_nsec();
+    while (spent < budget) {
+        nevt = evm_wait(s, 0);
+        s->stats.nspin++;
+        spent = monotonic_nsec() - start;
+        if (nevt) {
+            s->stats.spin_nsec += (uint64_t)spent;
+            if (nevt > 0) {
+                s->stats.nspin_event += (uint64_t)nevt;
+                busypoll_update(bp, spent);
+            }
+            return nevt;
+        }
+    }
+    s->stats.spin_nsec += (uint64_t)spent;
+
+    // block with the remaining timeout
+    if (timeout > 0) {
+        timeout -= spent;
+        if (timeout <= 0) {
+            busypoll_update(bp, spent);
+            return 0;
+        }
+    }
+    nevt = evm_wait(s, timeout);
+    if (nevt != -1) {
+        busypoll_update(bp, monotonic_nsec() - start);
+    }
+
+    return nevt;
+}
+
+// interval to poll the new events if only the collected events are ready
+#define EVM_BATCH_INTERVAL 50000
+
+// wait more events into the rest of the buffer, and merge the events that
+// have been collected already. returns the number of the new events.
+static int waitmore(evm_t *s, lua_Integer timeout, int *nready)
+{
+    kevt_t *evs = s->evs + s->nevt;
+    int nevs    = s->nreg - s->nevt;
+    int nevt    = 0;
+    int nnew    = 0;
+
+    // the rest of the events are kept in the kernel
+    if (s->maxevt && s->maxevt < nevs) {
+        nevs = s->maxevt;
+    }
+    nevt = evm_wait_into(s, evs, nevs, timeout);
+
+    *nready = nevt;
+    for (int i = 0; i < nevt; i++) {
+        int dup = 0;
+
+        for (int j = 0; j < s->nevt; j++) {
+            if (evm_kevt_equal(&s->evs[j], &evs[i])) {
+                evm_kevt_merge(&s->evs[j], &evs[i]);
+                dup = 1;
+                break;
+            }
+        }
+        if (!dup) {
+            evs[nnew++] = evs[i];
+        }
+    }
+
+    return (nevt == -1) ? -1 : nnew;
+}
+
+// keep collecting the events until min events are ready or delay has passed
+// since the first event
+static void waitbatch(evm_t *s, int min, lua_Integer delay)
+{
+    lua_Integer deadline = monotonic_nsec() + delay;
+
+    while (s->nevt < min && s->nevt < s->nreg) {
+        lua_Integer remain = deadline - monotonic_nsec();
+        int nready         = 0;
+        int nnew           = 0;
+
+        if (remain <= 0 || (nnew = waitmore(s, remain, &nready)) == -1) {
+            // the error will be reported by the next wait
+            return;
+        }
+        s->nevt += nnew;
+        s->stats.nbatch++;
+        // the level-triggered events are ready again without new events
+        if (!nnew && nready) {
+            struct timespec ts = evm_nsec2timespec(
+                (remain < EVM_BATCH_INTERVAL) ? remain : EVM_BATCH_INTERVAL);
+            nanosleep(&ts, NULL);
+        }
+    }
+}
+
+// reserve the buffer to sort the occurred events
+static int reserve_sorted(evm_t *s, int nevt)
+{
+    if (s->nsorted < nevt) {
+        kevt_t *sorted = prealloc((size_t)nevt, kevt_t, s->sorted);
+
+        if (!sorted) {
+            return -1;
+        }
+        s->sorted  = sorted;
+        s->nsorted = nevt;
+    }
+    return 0;
+}
+
+// class of the new event to sort. the timer events are placed above all the
+// priorities
+static inline int kevt_class(evm_t *s, kevt_t *evt)
+{
+    evm_ev_t *e = evm_kevt_ev(s, evt);
+
+    if (!e) {
+        return 0;
+    } else if (evm_ev_filter(e) == EVFILT_TIMER) {
+        return EVM_PRIO_MAX;
+    }
+    return s->prioritized ? e->prio : 0;
+}
+
+// reorder the events occurred after the nleft carried events so that
+// evm_getev delivers the carried events first, the new timer events next, and
+// then the other new events in priority order. the events of the same class
+// are delivered in kernel order, rotated by one for each wait if prioritized,
+// so that the last ones do not starve. the other new events are left at the
+// bottom of the events, and s->nrest is set to their number, so that the
+// expired deadlines are delivered before them.
+static int reorder(evm_t *s, int nleft)
+{
+    int cnt[EVM_PRIO_MAX + 1]  = {0};
+    int off[EVM_PRIO_MAX + 1]  = {0};
+    int seen[EVM_PRIO_MAX + 1] = {0};
+    unsigned int rot           = 0;
+    int nevt                   = s->nevt - nleft;
+    kevt_t *evs                = s->evs + nleft;
+
+    s->nrest = 0;
+    if (nevt < 1) {
+        return 0;
+    }
+    for (int i = 0; i < nevt; i++) {
+        cnt[kevt_class(s, &evs[i])]++;
+    }
+    s->nrest = nevt - cnt[EVM_PRIO_MAX];
+    if (!nleft && (!s->prioritized || nevt < 2) &&
+        (!s->nrest || s->nrest == nevt)) {
+        // already in order
+        return 0;
+    } else if (reserve_sorted(s, nevt) == -1) {
+        // the events are delivered in the default order
+        s->nrest = 0;
+        return -1;
+    }
+
+    if (s->prioritized) {
+        rot = s->rotation++;
+    }
+    // highest class first
+    for (int i = EVM_PRIO_MAX - 1; i >= 0; i--) {
+        off[i] = off[i + 1] + cnt[i + 1];
+    }
+    for (int i = 0; i < nevt; i++) {
+        int cls = kevt_class(s, &evs[i]);
+        int pos = (int)((seen[cls]++ + rot) % (unsigned int)cnt[cls]);
+
+        s->sorted[off[cls] + pos] = evs[i];
+    }
+    // evm_getev takes the events from the end, so the carried events are
+    // moved on top of the new events
+    memmove(s->evs + nevt, s->evs, sizeof(kevt_t) * (size_t)nleft);
+    for (int i = 0; i < nevt; i++) {
+        s->evs[nevt - 1 - i] = s->sorted[i];
+    }
+    return 0;
+}
+
+static int postq_push(evm_postq_t *q, int ref, int ctx)
+{
+    int tail = 0;
+
+    if (q->len == q->size) {
+        int size  = q->size ? q->size * 2 : 16;
+        int *refs = prealloc((size_t)size * 2, int, q->refs);
+
+        if (!refs) {
+            return -1;
+        }
+        // move the wrapped entries to the end of the new buffer
+        if (q->head) {
+            memcpy(refs + q->size * 2, refs, sizeof(int) * (size_t)q->head * 2);
+        }
+        q->refs = refs;
+        q->size = size;
+    }
+    tail                  = (q->head + q->len++) % q->size;
+    q->refs[tail * 2]     = ref;
+    q->refs[tail * 2 + 1] = ctx;
+
+    return 0;
+}
+
+static void postq_shift(evm_postq_t *q, int *ref, int *ctx)
+{
+    *ref    = q->refs[q->head * 2];
+    *ctx    = q->refs[q->head * 2 + 1];
+    q->head = (q->head + 1) % q->size;
+    q->len--;
+    q->nready--;
+}
+
+static void compact_hooks(evm_t *s)
+{
+    for (int k = 0; k < EVM_HOOK_NKIND; k++) {
+        evm_hooks_t *h = &s->hooks[k];
+        int n          = 0;
+
+        // remove the hooks in registration order
+        for (int i = 0; i < h->len; i++) {
+            if (lauxh_isref(h->list[i].fn)) {
+                h->list[n++] = h->list[i];
+            }
+        }
+        h->len = n;
+    }
+}
+
+static void run_hooks(lua_State *L, evm_t *s, int kind)
+{
+    // the hooks added by the hook will run in the next iteration
+    int n = s->hooks[kind].len;
+
+    if (!n) {
+        return;
+    }
+
+    s->nhookrun++;
+    for (int i = 0; i < n; i++) {
+        // list may be reallocated by the hook
+        evm_hook_t *hook = &s->hooks[kind].list[i];
+
+        if (!lauxh_isref(hook->fn)) {
+            // removed by the hook
+            continue;
+        }
+        lauxh_pushref(L, hook->fn);
+        if (lauxh_isref(hook->ctx)) {
+            lauxh_pushref(L, hook->ctx);
+        } else {
+            lua_pushnil(L);
+        }
+        if (lua_pcall(L, 1, 0, 0) != 0) {
+            // rethrow the error of the hook
+            if (--s->nhookrun == 0) {
+                compact_hooks(s);
+            }
+            lua_error(L);
+        }
+    }
+    if (--s->nhookrun == 0) {
+        compact_hooks(s);
+    }
+}
+
+// returns 1 if the collector is running, 0 if it is stopped, or -1 if it is
+// unknown
+static int gc_isrunning(lua_State *L)
+{
+#if defined(LUA_GCISRUNNING)
+    return lua_gc(L, LUA_GCISRUNNING, 0);
+#else
+    (void)L;
+    return -1;
+#endif
+}
+
+// raise the pause of the collector not to start a new cycle while dispatching
+static void gc_slowdown(lua_State *L, evm_idlegc_t *gc)
+{
+#if defined(LUA_GCSETPAUSE)
+    int pause = lua_gc(L, LUA_GCSETPAUSE, EVM_IDLEGC_SLOWPAUSE);
+
+    // already slowed down by the other loop that restores it
+    if (pause != EVM_IDLEGC_SLOWPAUSE) {
+        gc->pause  = pause;
+        gc->slowed = 1;
+    }
+#else
+    (void)L;
+    (void)gc;
+#endif
+}
+
+static void gc_restore(lua_State *L, evm_idlegc_t *gc)
+{
+#if defined(LUA_GCSETPAUSE)
+    if (gc->slowed) {
+        gc->slowed = 0;
+        lua_gc(L, LUA_GCSETPAUSE, gc->pause);
+    }
+#else
+    (void)L;
+    (void)gc;
+#endif
+}
+
+static int idlegc(lua_State *L, evm_t *s, lua_Integer *timeout)
+{
+    evm_idlegc_t *gc  = &s->idlegc;
+    lua_Integer start = 0;
+    lua_Integer spent = 0;
+    int kb            = 0;
+
+    // do not delay the next timer, and do not restart the collector stopped
+    // by the user
+    if (!gc->kb || (*timeout >= 0 && *timeout <= gc->nsec) ||
+        gc_isrunning(L) == 0) {
+        return 0;
+    }
+    // do not delay the pending events
+    if ((s->nevt = evm_wait(s, 0)) != 0) {
+        return 0;
+    }
+
+    start = monotonic_nsec();
+    kb    = lua_gc(L, LUA_GCCOUNT, 0);
+    do {
+        if (lua_gc(L, LUA_GCSTEP, gc->kb)) {
+            // stop at the end of cycle not to start a new cycle
+            s->stats.ngccycle++;
+            break;
+        }
+        spent = monotonic_nsec() - start;
+    } while (spent < gc->nsec);
+    spent = monotonic_nsec() - start;
+    kb -= lua_gc(L, LUA_GCCOUNT, 0);
+
+    s->stats.ngcidle++;
+    s->stats.gcidle_nsec += (uint64_t)spent;
+    if (kb > 0) {
+        s->stats.gcidle_kb += (uint64_t)kb;
+    }
+    if (*timeout > 0) {
+        *timeout = (spent < *timeout) ? *timeout - spent : 0;
+    }
+    return 1;
+}
 
 static int wait_lua(lua_State *L)
 {
     evm_t *s            = luaL_checkudata(L, 1, EVM_MT);
     // default timeout: -1(never timeout)
-    lua_Integer timeout = lauxh_optinteger(L, 2, -1);
+    lua_Number msec     = lauxh_optnumber(L, 2, -1);
+    lua_Integer timeout = (msec < 0) ? -1 : evm_msec2nsec(msec);
+    lua_Integer next    = 0;
+    lua_Integer delay   = 0;
     evm_ev_t *e         = NULL;
     int isdel           = 0;
+    int nexp            = 0;
+    int min             = 1;
+    int nleft           = 0;
+    int carry           = 0;
+    int gcidle          = 0;
 
     // check arguments
-    // cleanup current events
-    while ((e = evm_getev(s, &isdel))) {
-        if (isdel) {
-            isdel  = 0;
-            e->ref = lauxh_unref(L, e->ref);
-            s->nreg--;
+    if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        lua_getfield(L, 3, "min_events");
+        min = (int)lauxh_optinteger(L, -1, min);
+        lua_getfield(L, 3, "max_delay_us");
+        delay = lauxh_optinteger(L, -1, delay);
+        lua_pop(L, 2);
+        if (min < 1) {
+            return lauxh_argerror(L, 3, "opts.min_events must be greater than 0");
+        } else if (delay < 0) {
+            return lauxh_argerror(L, 3,
+                                  "opts.max_delay_us must not be less than 0");
         }
+        delay *= 1000;
+    }
+
+    if (s->nreg > 0 && (s->budget.nevent || s->budget.nsec) &&
+        (s->nevt > 0 || evm_nbuffered(s))) {
+        // carry over the events that exceeded the budget, including the
+        // buffered inotify events and completed jobs
+        carry = 1;
+        nleft = s->nevt;
+        s->stats.ncarried += (uint64_t)(nleft + evm_nbuffered(s));
+    } else {
+        // cleanup current events
+        while ((e = evm_getev(s, &isdel))) {
+            if (isdel) {
+                isdel  = 0;
+                e->ref = lauxh_unref(L, e->ref);
+                evm_ev_unlink(e);
+            }
+        }
+        s->nevt  = 0;
+        s->nrest = 0;
+    }
+
+    // restore the collector slowed down while dispatching
+    gc_restore(L, &s->idlegc);
+    run_hooks(L, s, EVM_HOOK_PREPARE);
+
+    // deliver the objects posted before this wait, and do not block
+    s->postq.nready = s->postq.len;
+    if (s->postq.nready) {
+        timeout = 0;
     }
 
-    s->nevt = 0;
     if (s->nreg == 0) {
         // do not wait the event occurrs if no registered events exists
-        lua_pushinteger(L, 0);
+        evm_update_now(s);
+        run_hooks(L, s, EVM_HOOK_CHECK);
+        if (!s->postq.nready) {
+            run_hooks(L, s, EVM_HOOK_IDLE);
+        }
+        lua_pushinteger(L, s->postq.nready);
         return 1;
     }
 
+    // wake up at the earliest deadline of the events
+    next = evm_deadline_next(s);
+    if (next != -1 && (timeout < 0 || next < timeout)) {
+        timeout = next;
+    }
+
     // wait event
-    s->nevt = evm_wait(s, timeout);
+    s->ntimer = 0;
+    if (carry) {
+        int nready = 0;
+        // collect the new events without blocking
+        int nnew   = waitmore(s, 0, &nready);
+
+        // the error will be reported by the next wait
+        if (nnew > 0) {
+            s->nevt += nnew;
+            // deliver the events in the default order on failure
+            reorder(s, nleft);
+        } else {
+            // the expired deadlines are delivered after the carried events
+            s->nrest = 0;
+        }
+    } else {
+        if (!s->postq.nready && timeout) {
+            // collect garbage while no events are pending
+            gcidle = idlegc(L, s, &timeout);
+        }
+        if (!s->nevt) {
+            s->nevt = busywait(s, timeout);
+        }
+        if (s->nevt > 0 && s->nevt < min && delay && !s->postq.nready) {
+            waitbatch(s, min, delay);
+        }
+        // the events are delivered in the default order on failure
+        reorder(s, 0);
+    }
+    evm_update_now(s);
+    s->stats.nwait++;
+    // start the iteration of the dispatch budget
+    s->budget.ndelivered = 0;
+    if (s->budget.nsec) {
+        s->budget.start = monotonic_nsec();
+    }
     if (s->nevt != -1) {
+        // expired deadlines are delivered before the new events other than
+        // the timers
+        nexp = evm_deadline_nexpired(&s->deadlines, 0,
+                                     evm_timespec2nsec(&s->clock.mono));
+        s->stats.nevent += (uint64_t)(s->nevt - nleft);
+        nexp += s->nevt + s->postq.nready;
+        if (carry) {
+            nexp += evm_nbuffered(s);
+        }
+        if (gcidle && nexp && s->idlegc.slow) {
+            // defer the next collection cycle to the next idle time
+            s->stats.ngcslow++;
+            gc_slowdown(L, &s->idlegc);
+        }
+        run_hooks(L, s, EVM_HOOK_CHECK);
+        if (!nexp) {
+            run_hooks(L, s, EVM_HOOK_IDLE);
+        }
         // return number of event
-        lua_pushinteger(L, s->nevt);
+        lua_pushinteger(L, nexp);
         return 1;
     }
 
@@ -69,6 +568,8 @@ static int wait_lua(lua_State *L)
     case EINTR:
         s->nevt = 0;
         errno   = 0;
+        run_hooks(L, s, EVM_HOOK_CHECK);
+        run_hooks(L, s, EVM_HOOK_IDLE);
         lua_pushinteger(L, 0);
         return 1;
 
@@ -80,16 +581,126 @@ static int wait_lua(lua_State *L)
     }
 }
 
+// poll the child loop of the loop event without blocking, and push the number
+// of the events of the child. unlike the wait of the child, the events that
+// have not been delivered by the child yet are kept, and the hooks and the
+// idle collection of the child are not run.
+int evm_loop_pushresult(lua_State *L, evm_ev_t *e)
+{
+    evm_t *s   = e->loop;
+    int nleft  = 0;
+    int nnew   = 0;
+    int nready = 0;
+    int nexp   = 0;
+
+    if (s->nevt > 0) {
+        nleft = s->nevt;
+    } else {
+        s->nevt = 0;
+    }
+
+    // the rest of the events are kept in the kernel of the child, so the loop
+    // event occurs again in the next iteration
+    s->ntimer = 0;
+    s->maxevt = e->loopmax;
+    if (s->nreg > s->nevt) {
+        nnew = waitmore(s, 0, &nready);
+    }
+    s->maxevt = 0;
+    if (nnew == -1) {
+        if (!nleft && errno != EINTR && errno != ENOENT) {
+            lua_pushinteger(L, 0);
+            lua_errno_new(L, errno, "wait");
+            return 2;
+        }
+        // the error will be reported by the next wait
+        nnew = 0;
+    }
+    s->nevt += nnew;
+    // the events are delivered in the default order on failure
+    reorder(s, nleft);
+
+    evm_update_now(s);
+    s->stats.nwait++;
+    s->stats.nevent += (uint64_t)nnew;
+    s->budget.ndelivered = 0;
+    if (s->budget.nsec) {
+        s->budget.start = monotonic_nsec();
+    }
+    nexp = evm_deadline_nexpired(&s->deadlines, 0,
+                                 evm_timespec2nsec(&s->clock.mono));
+    nexp += s->nevt + s->postq.nready + evm_nbuffered(s);
+    lua_pushinteger(L, nexp);
+
+    return 1;
+}
+
 static int getevent_lua(lua_State *L)
 {
-    evm_t *s    = luaL_checkudata(L, 1, EVM_MT);
-    int isdel   = 0;
-    evm_ev_t *e = evm_getev(s, &isdel);
+    evm_t *s     = luaL_checkudata(L, 1, EVM_MT);
+    int isdel    = 0;
+    int nres     = 0;
+    int timedout = 0;
+    evm_ev_t *e  = NULL;
 
-    if (!e) {
+    // the rest of the events are carried over to the next iteration if the
+    // dispatch budget is exhausted
+    if ((s->budget.nevent && s->budget.ndelivered >= s->budget.nevent) ||
+        (s->budget.nsec &&
+         monotonic_nsec() - s->budget.start >= s->budget.nsec)) {
         lua_pushnil(L);
         return 1;
     }
+    s->budget.ndelivered++;
+
+    // deliver the posted objects first
+    if (s->postq.nready > 0) {
+        int ref = LUA_NOREF;
+        int ctx = LUA_NOREF;
+
+        postq_shift(&s->postq, &ref, &ctx);
+        lauxh_pushref(L, ref);
+        lauxh_unref(L, ref);
+        if (lauxh_isref(ctx)) {
+            lauxh_pushref(L, ctx);
+            lauxh_unref(L, ctx);
+        } else {
+            lua_pushnil(L);
+        }
+        return 2;
+    }
+
+    // deliver the events whose deadline has expired after the carried events
+    // and the new timer events
+    if (s->nevt <= s->nrest && !evm_nbuffered(s)) {
+        timedout = (e = evm_deadline_getev(s)) != NULL;
+    }
+    if (!e && !(e = evm_getev(s, &isdel))) {
+        if (!(e = evm_deadline_getev(s))) {
+            lua_pushnil(L);
+            return 1;
+        }
+        timedout = 1;
+    }
+    if (timedout) {
+        lauxh_pushref(L, e->ref);
+        if (lauxh_isref(e->ctx)) {
+            lauxh_pushref(L, e->ctx);
+        } else {
+            lua_pushnil(L);
+        }
+        // push disabled and timedout
+        lua_pushboolean(L, 0);
+        lua_pushboolean(L, 1);
+        return 4;
+    }
+    // the event is ready in time
+    evm_deadline_del(e);
+
+    // count the timers that expired in the same wakeup
+    if (evm_ev_filter(e) == EVFILT_TIMER && s->ntimer++) {
+        s->stats.ncoalesced++;
+    }
 
     // return event, isdel and context
     lauxh_pushref(L, e->ref);
@@ -100,28 +711,20 @@ static int getevent_lua(lua_State *L)
         lua_pushnil(L);
     }
 
+    // push isdel followed by the type-specific results
+    lua_pushboolean(L, isdel);
+    nres = evm_ev_pushresult(L, e);
+
     // release reference if deleted
     if (isdel) {
-        lua_pushboolean(L, isdel);
         e->ref = lauxh_unref(L, e->ref);
-        s->nreg--;
-        return 3;
+        evm_ev_unlink(e);
+    } else if (!nres) {
+        lua_pop(L, 1);
+        return 2;
     }
 
-    return 2;
-}
-
-static inline void allocevent(lua_State *L, evm_t *s)
-{
-    evm_ev_t *e = lua_newuserdata(L, sizeof(evm_ev_t));
-
-    *e = (evm_ev_t){
-        .s   = s,
-        .ctx = LUA_NOREF,
-        .ref = LUA_NOREF,
-    };
-    // set metatable
-    lauxh_setmetatable(L, EVM_EVENT_MT);
+    return 3 + nres;
 }
 
 static int newevents_lua(lua_State *L)
@@ -136,7 +739,7 @@ static int newevents_lua(lua_State *L)
     lua_settop(L, 1);
     lua_createtable(L, nevt, 0);
     for (int i = 1; i <= nevt; i++) {
-        allocevent(L, s);
+        evm_ev_alloc(L, s);
         lua_rawseti(L, -2, i);
     }
     return 1;
@@ -145,31 +748,283 @@ static int newevents_lua(lua_State *L)
 static int newevent_lua(lua_State *L)
 {
     evm_t *s = luaL_checkudata(L, 1, EVM_MT);
-    allocevent(L, s);
+    evm_ev_alloc(L, s);
     return 1;
 }
 
-static int renew_lua(lua_State *L)
+// recreate the event descriptor
+static int renewfd(evm_t *s)
 {
-    evm_t *s = luaL_checkudata(L, 1, EVM_MT);
-    int fd   = evm_createfd();
+    int fd = evm_createfd();
 
     if (fd == -1) {
-        // got error
-        lua_pushboolean(L, 0);
-        lua_errno_new(L, errno, "renew");
-        return 2;
+        return -1;
     }
 
     // close unused descriptor
-    if (s->fd != fd) {
+    if (s->fd != -1 && s->fd != fd) {
         close(s->fd);
     }
     s->fd = fd;
+    if (s->busypoll.max) {
+        evm_set_busypoll(s);
+    }
+    // internal descriptors must be registered to the new one
+    if (s->cq) {
+        s->cq->epfd = -1;
+    }
+#if defined(EVM_USE_INOTIFY)
+    s->inotify.epfd = -1;
+#endif
+
+    return 0;
+}
+
+static int renew_lua(lua_State *L)
+{
+    evm_t *s       = luaL_checkudata(L, 1, EVM_MT);
+    int reregister = 0;
+    int err        = 0;
+
+    // arg#2 options
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_getfield(L, 2, "reregister");
+        reregister = lauxh_optboolean(L, -1, 0);
+        lua_pop(L, 1);
+    }
+
+    if (renewfd(s) == -1) {
+        err = errno;
+    } else if (reregister) {
+        err = evm_reregister(s);
+    }
+
+    if (err) {
+        // got error
+        lua_pushboolean(L, 0);
+        lua_errno_new(L, err, "renew");
+        return 2;
+    }
     lua_pushboolean(L, 1);
     return 1;
 }
 
+static int now_lua(lua_State *L)
+{
+    evm_t *s = luaL_checkudata(L, 1, EVM_MT);
+    lua_pushnumber(L, evm_timespec2sec(&s->clock.now));
+    return 1;
+}
+
+static int now_realtime_lua(lua_State *L)
+{
+    evm_t *s = luaL_checkudata(L, 1, EVM_MT);
+    lua_pushnumber(L, evm_timespec2sec(&s->clock.now_rt));
+    return 1;
+}
+
+static int update_now_lua(lua_State *L)
+{
+    evm_t *s = luaL_checkudata(L, 1, EVM_MT);
+    evm_update_now(s);
+    lua_pushnumber(L, evm_timespec2sec(&s->clock.now));
+    return 1;
+}
+
+static int post_lua(lua_State *L)
+{
+    evm_t *s = luaL_checkudata(L, 1, EVM_MT);
+    int type = lua_type(L, 2);
+    int ref  = LUA_NOREF;
+    int ctx  = LUA_NOREF;
+
+    // check arguments
+    if (type != LUA_TFUNCTION && type != LUA_TUSERDATA) {
+        return luaL_argerror(L, 2, "function or event object expected");
+    }
+    if (!lua_isnoneornil(L, 3)) {
+        ctx = evm_retain_context(L, 3);
+    }
+    ref = lauxh_refat(L, 2);
+
+    if (postq_push(&s->postq, ref, ctx) == -1) {
+        // got error
+        lauxh_unref(L, ref);
+        lauxh_unref(L, ctx);
+        lua_pushboolean(L, 0);
+        lua_errno_new(L, errno, "post");
+        return 2;
+    }
+    s->stats.nposted++;
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// names of the hook kinds in the order of EVM_HOOK_*
+static const char *const EVM_HOOK_KINDS[] = {
+    "prepare",
+    "check",
+    "idle",
+    NULL,
+};
+
+static int hook_lua(lua_State *L)
+{
+    evm_t *s       = luaL_checkudata(L, 1, EVM_MT);
+    int kind       = luaL_checkoption(L, 2, NULL, EVM_HOOK_KINDS);
+    evm_hooks_t *h = &s->hooks[kind];
+    int ctx        = LUA_NOREF;
+
+    // check arguments
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+    if (h->len == h->size) {
+        int size         = h->size ? h->size * 2 : 4;
+        evm_hook_t *list = prealloc((size_t)size, evm_hook_t, h->list);
+
+        if (!list) {
+            // got error
+            lua_pushnil(L);
+            lua_errno_new(L, errno, "hook");
+            return 2;
+        }
+        h->list = list;
+        h->size = size;
+    }
+    if (!lua_isnoneornil(L, 4)) {
+        ctx = evm_retain_context(L, 4);
+    }
+    h->list[h->len++] = (evm_hook_t){
+        .id  = ++s->hookid,
+        .fn  = lauxh_refat(L, 3),
+        .ctx = ctx,
+    };
+    lua_pushinteger(L, s->hookid);
+    return 1;
+}
+
+static int unhook_lua(lua_State *L)
+{
+    evm_t *s       = luaL_checkudata(L, 1, EVM_MT);
+    lua_Integer id = lauxh_checkinteger(L, 2);
+
+    for (int k = 0; k < EVM_HOOK_NKIND; k++) {
+        evm_hooks_t *h = &s->hooks[k];
+
+        for (int i = 0; i < h->len; i++) {
+            evm_hook_t *hook = &h->list[i];
+
+            if (hook->id == id && lauxh_isref(hook->fn)) {
+                hook->fn  = lauxh_unref(L, hook->fn);
+                hook->ctx = lauxh_unref(L, hook->ctx);
+                // the running hooks are removed after they returned
+                if (!s->nhookrun) {
+                    compact_hooks(s);
+                }
+                lua_pushboolean(L, 1);
+                return 1;
+            }
+        }
+    }
+    lua_pushboolean(L, 0);
+    return 1;
+}
+
+static int budget_lua(lua_State *L)
+{
+    evm_t *s = luaL_checkudata(L, 1, EVM_MT);
+
+    if (lua_gettop(L) > 1) {
+        lua_Integer nevent = lauxh_optinteger(L, 2, 0);
+        lua_Integer usec   = lauxh_optinteger(L, 3, 0);
+
+        if (nevent < 0 || nevent > INT_MAX) {
+            return lauxh_argerror(L, 2, "nevent value range must be 0 to %d",
+                                  INT_MAX);
+        } else if (usec < 0 || usec > INT_MAX) {
+            return lauxh_argerror(L, 3, "usec value range must be 0 to %d",
+                                  INT_MAX);
+        }
+        s->budget.nevent = (int)nevent;
+        s->budget.nsec   = usec * 1000;
+    }
+    lua_pushinteger(L, s->budget.nevent);
+    lua_pushinteger(L, s->budget.nsec / 1000);
+    return 2;
+}
+
+static int idlegc_lua(lua_State *L)
+{
+    evm_t *s = luaL_checkudata(L, 1, EVM_MT);
+
+    if (lua_gettop(L) > 1) {
+        lua_Integer kb   = lauxh_optinteger(L, 2, 0);
+        lua_Integer usec = lauxh_optinteger(L, 3, 1000);
+        int slow         = lauxh_optboolean(L, 4, 0);
+
+        if (kb < 0 || kb > INT_MAX) {
+            return lauxh_argerror(L, 2, "kb value range must be 0 to %d",
+                                  INT_MAX);
+        } else if (usec < 1 || usec > INT_MAX) {
+            return lauxh_argerror(L, 3, "usec value range must be 1 to %d",
+                                  INT_MAX);
+        }
+        s->idlegc.kb   = (int)kb;
+        s->idlegc.nsec = usec * 1000;
+        s->idlegc.slow = slow;
+    }
+    lua_pushinteger(L, s->idlegc.kb);
+    lua_pushinteger(L, s->idlegc.nsec / 1000);
+    lua_pushboolean(L, s->idlegc.slow);
+    return 3;
+}
+
+static int busypoll_lua(lua_State *L)
+{
+    evm_t *s = luaL_checkudata(L, 1, EVM_MT);
+
+    if (!lua_isnoneornil(L, 2)) {
+        lua_Integer usec = lauxh_checkinteger(L, 2);
+
+        if (usec < 0 || usec > INT_MAX) {
+            return lauxh_argerror(L, 2, "usec value range must be 0 to %d",
+                                  INT_MAX);
+        }
+        s->busypoll = (evm_busypoll_t){
+            .max = usec * 1000,
+            .avg = usec * 1000,
+        };
+        evm_set_busypoll(s);
+    }
+    lua_pushinteger(L, s->busypoll.max / 1000);
+    return 1;
+}
+
+static int stats_lua(lua_State *L)
+{
+    evm_t *s = luaL_checkudata(L, 1, EVM_MT);
+
+    lua_createtable(L, 0, 16);
+    lauxh_pushint2tbl(L, "nwait", (lua_Integer)s->stats.nwait);
+    lauxh_pushint2tbl(L, "nevent", (lua_Integer)s->stats.nevent);
+    lauxh_pushint2tbl(L, "ncoalesced", (lua_Integer)s->stats.ncoalesced);
+    lauxh_pushint2tbl(L, "ntimedout", (lua_Integer)s->stats.ntimedout);
+    lauxh_pushint2tbl(L, "nspin", (lua_Integer)s->stats.nspin);
+    lauxh_pushint2tbl(L, "nspin_event", (lua_Integer)s->stats.nspin_event);
+    lauxh_pushint2tbl(L, "spin_usec", (lua_Integer)(s->stats.spin_nsec / 1000));
+    lauxh_pushint2tbl(L, "nbatch", (lua_Integer)s->stats.nbatch);
+    lauxh_pushint2tbl(L, "ncarried", (lua_Integer)s->stats.ncarried);
+    lauxh_pushint2tbl(L, "nposted", (lua_Integer)s->stats.nposted);
+    lauxh_pushint2tbl(L, "ngcidle", (lua_Integer)s->stats.ngcidle);
+    lauxh_pushint2tbl(L, "ngccycle", (lua_Integer)s->stats.ngccycle);
+    lauxh_pushint2tbl(L, "gcidle_usec",
+                      (lua_Integer)(s->stats.gcidle_nsec / 1000));
+    lauxh_pushint2tbl(L, "gcidle_kb", (lua_Integer)s->stats.gcidle_kb);
+    lauxh_pushint2tbl(L, "ngcslow", (lua_Integer)s->stats.ngcslow);
+    lauxh_pushint2tbl(L, "nreg", s->nreg);
+    return 1;
+}
+
 static int len_lua(lua_State *L)
 {
     evm_t *s = luaL_checkudata(L, 1, EVM_MT);
@@ -190,23 +1045,67 @@ static int gc_lua(lua_State *L)
     if (s->fd != -1) {
         close(s->fd);
     }
+    // NOTE: lua_gc does nothing in the finalizer on Lua 5.4, so the pause
+    // raised while dispatching is left as it is
+    gc_restore(L, &s->idlegc);
     pdealloc(s->evs);
+    pdealloc(s->deadlines.evs);
+    pdealloc(s->sorted);
+    // release the posted objects that are not delivered
+    for (int i = 0; i < s->postq.len; i++) {
+        int idx = (s->postq.head + i) % s->postq.size;
+
+        lauxh_unref(L, s->postq.refs[idx * 2]);
+        lauxh_unref(L, s->postq.refs[idx * 2 + 1]);
+    }
+    pdealloc(s->postq.refs);
+    // release the hooks
+    for (int k = 0; k < EVM_HOOK_NKIND; k++) {
+        for (int i = 0; i < s->hooks[k].len; i++) {
+            lauxh_unref(L, s->hooks[k].list[i].fn);
+            lauxh_unref(L, s->hooks[k].list[i].ctx);
+        }
+        pdealloc(s->hooks[k].list);
+    }
     fdset_dealloc(&s->fds);
+    evm_dealloc(s);
+    evm_cq_release(s->cq);
 
     return 0;
 }
 
 // allocate evm data
-static int new_lua(lua_State *L)
+int evm_new_lua(lua_State *L)
 {
-    int nbuf = lauxh_optinteger(L, 1, 128);
-    evm_t *s = NULL;
+    int nbuf          = lauxh_optinteger(L, 1, 128);
+    int coarse        = EVM_COARSE_CLOCK_DEFAULT;
+    lua_Integer slack = 0;
+    lua_Integer busy  = 0;
+    evm_t *s          = NULL;
 
     // check arguments
     if (nbuf < 1 || nbuf > INT_MAX) {
         return lauxh_argerror(L, 1, "event buffer value range must be 1 to %d",
                               INT_MAX);
     }
+    // arg#2 options
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_getfield(L, 2, "coarse");
+        coarse = lauxh_optboolean(L, -1, coarse);
+        lua_getfield(L, 2, "slack");
+        slack = lauxh_optinteger(L, -1, slack);
+        lua_getfield(L, 2, "busypoll");
+        busy = lauxh_optinteger(L, -1, busy);
+        lua_pop(L, 3);
+        if (slack < 0 || slack > INT_MAX) {
+            return lauxh_argerror(L, 2, "opts.slack value range must be 0 to %d",
+                                  INT_MAX);
+        } else if (busy < 0 || busy > INT_MAX) {
+            return lauxh_argerror(
+                L, 2, "opts.busypoll value range must be 0 to %d", INT_MAX);
+        }
+    }
 
     // create and init evm_t
     s = lua_newuserdata(L, sizeof(evm_t));
@@ -215,10 +1114,41 @@ static int new_lua(lua_State *L)
             // create event descriptor
             if ((s->fd = evm_createfd()) != -1) {
                 lauxh_setmetatable(L, EVM_MT);
-                s->nbuf = nbuf;
-                s->nreg = 0;
-                s->nevt = 0;
+                s->nbuf   = nbuf;
+                s->nreg   = 0;
+                s->nevt   = 0;
+                s->nrest  = 0;
+                s->maxevt = 0;
+                s->regs   = NULL;
+                s->cq     = NULL;
+                s->stats  = (evm_stats_t){0};
+                s->clock  = (evm_clock_t){.coarse = coarse};
+                evm_update_now(s);
+                s->slack     = slack;
+                s->seed      = (unsigned int)(s->clock.now.tv_nsec ^ getpid());
+                s->ntimer    = 0;
+                s->deadlines = (evm_deadlines_t){0};
+                s->busypoll  = (evm_busypoll_t){
+                    .max = busy * 1000,
+                    .avg = busy * 1000,
+                };
+                s->prioritized = 0;
+                s->rotation    = 0;
+                s->sorted      = NULL;
+                s->nsorted     = 0;
+                s->budget      = (evm_budget_t){0};
+                s->postq       = (evm_postq_t){0};
+                for (int k = 0; k < EVM_HOOK_NKIND; k++) {
+                    s->hooks[k] = (evm_hooks_t){0};
+                }
+                s->hookid   = 0;
+                s->nhookrun = 0;
+                s->idlegc   = (evm_idlegc_t){.nsec = 1000000};
                 sigemptyset(&s->signals);
+                evm_init(s);
+                if (busy) {
+                    evm_set_busypoll(s);
+                }
                 return 1;
             }
             fdset_dealloc(&s->fds);
@@ -242,6 +1172,14 @@ static int default_lua(lua_State *L)
             return 1;
         } else {
             evm_t *s = luaL_checkudata(L, -1, EVM_MT);
+
+            // renew the event descriptor inherited from the parent process,
+            // and register the inherited events to it
+            if (renewfd(s) == 0) {
+                evm_reregister(s);
+                EVM_PID = getpid();
+                return 1;
+            }
             // should close event descriptor
             close(s->fd);
             // invalid value
@@ -253,7 +1191,7 @@ static int default_lua(lua_State *L)
     }
 
     // create new default evm
-    if (new_lua(L) == 1) {
+    if (evm_new_lua(L) == 1) {
         DEFAULT_EVM = lauxh_refat(L, -1);
         EVM_PID     = getpid();
         return 1;
@@ -271,12 +1209,24 @@ LUALIB_API int luaopen_evm(lua_State *L)
         {NULL,         NULL        }
     };
     struct luaL_Reg method[] = {
-        {"renew",     renew_lua    },
-        {"newevent",  newevent_lua },
-        {"newevents", newevents_lua},
-        {"getevent",  getevent_lua },
-        {"wait",      wait_lua     },
-        {NULL,        NULL         }
+        {"renew",        renew_lua          },
+        {"newevent",     newevent_lua       },
+        {"newevents",    newevents_lua      },
+        {"export",       evm_export_lua     },
+        {"getevent",     getevent_lua       },
+        {"wait",         wait_lua           },
+        {"stats",        stats_lua          },
+        {"busypoll",     busypoll_lua       },
+        {"budget",       budget_lua         },
+        {"idlegc",       idlegc_lua         },
+        {"post",         post_lua           },
+        {"group",        evm_evgroup_new_lua},
+        {"hook",         hook_lua           },
+        {"unhook",       unhook_lua         },
+        {"now",          now_lua            },
+        {"now_realtime", now_realtime_lua   },
+        {"update_now",   update_now_lua     },
+        {NULL,           NULL               }
     };
 
     lua_errno_loadlib(L);
@@ -287,13 +1237,44 @@ LUALIB_API int luaopen_evm(lua_State *L)
     luaopen_evm_writable(L);
     luaopen_evm_timer(L);
     luaopen_evm_signal(L);
+    luaopen_evm_datagram(L);
+    luaopen_evm_proc(L);
+    luaopen_evm_watchpath(L);
+    luaopen_evm_pool(L);
+    luaopen_evm_job(L);
+    luaopen_evm_group(L);
+    luaopen_evm_handoff(L);
+    luaopen_evm_cluster(L);
+    luaopen_evm_channel(L);
+    luaopen_evm_message(L);
+    luaopen_evm_loop(L);
+    luaopen_evm_evgroup(L);
 
     // register evm-metatable
     evm_define_mt(L, EVM_MT, mmethod, method);
     // create table
     lua_newtable(L);
-    lauxh_pushfn2tbl(L, "new", new_lua);
+    lauxh_pushfn2tbl(L, "new", evm_new_lua);
     lauxh_pushfn2tbl(L, "default", default_lua);
+    lauxh_pushfn2tbl(L, "pool", evm_pool_new_lua);
+    lauxh_pushfn2tbl(L, "group", evm_group_new_lua);
+    lauxh_pushfn2tbl(L, "cluster", evm_cluster_new_lua);
+    lauxh_pushfn2tbl(L, "channel", evm_channel_new_lua);
+    lauxh_pushfn2tbl(L, "import", evm_import_lua);
+    // readiness mask
+    lauxh_pushint2tbl(L, "REV_READ", EVM_REV_READ);
+    lauxh_pushint2tbl(L, "REV_WRITE", EVM_REV_WRITE);
+    lauxh_pushint2tbl(L, "REV_HUP", EVM_REV_HUP);
+    lauxh_pushint2tbl(L, "REV_ERR", EVM_REV_ERR);
+    // path watch event mask
+    lauxh_pushint2tbl(L, "WATCH_MODIFY", EVM_WATCH_MODIFY);
+    lauxh_pushint2tbl(L, "WATCH_ATTRIB", EVM_WATCH_ATTRIB);
+    lauxh_pushint2tbl(L, "WATCH_CREATE", EVM_WATCH_CREATE);
+    lauxh_pushint2tbl(L, "WATCH_DELETE", EVM_WATCH_DELETE);
+    lauxh_pushint2tbl(L, "WATCH_MOVE", EVM_WATCH_MOVE);
+    lauxh_pushint2tbl(L, "WATCH_DELETE_SELF", EVM_WATCH_DELETE_SELF);
+    lauxh_pushint2tbl(L, "WATCH_MOVE_SELF", EVM_WATCH_MOVE_SELF);
+    lauxh_pushint2tbl(L, "WATCH_ALL", EVM_WATCH_ALL);
 
     return 1;
 }
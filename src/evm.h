@@ -27,30 +27,206 @@
 #ifndef evm_lua_h
 #define evm_lua_h
 
+// config.h must be included before system headers
+#include "config.h"
 #include <errno.h>
 #include <limits.h>
 #include <math.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 // lualib
 #include <lauxhlib.h>
 #include <lua_errno.h>
 // evm headers
-#include "config.h"
 #include "evm_types.h"
 #include "fdset.h"
 
+typedef struct evm_cq_st evm_cq_t;
+
+// clocks of the cached loop time
+#if defined(CLOCK_MONOTONIC_COARSE)
+# define EVM_CLOCK_MONOTONIC_COARSE CLOCK_MONOTONIC_COARSE
+#else
+# define EVM_CLOCK_MONOTONIC_COARSE CLOCK_MONOTONIC
+#endif
+#if defined(CLOCK_REALTIME_COARSE)
+# define EVM_CLOCK_REALTIME_COARSE CLOCK_REALTIME_COARSE
+#else
+# define EVM_CLOCK_REALTIME_COARSE CLOCK_REALTIME
+#endif
+
+// define EVM_USE_COARSE_CLOCK to use the coarse clocks by default
+#if defined(EVM_USE_COARSE_CLOCK)
+# define EVM_COARSE_CLOCK_DEFAULT 1
+#else
+# define EVM_COARSE_CLOCK_DEFAULT 0
+#endif
+
+// cached loop time
+typedef struct {
+    int coarse;
+    // time returned by m:now() and m:now_realtime()
+    struct timespec now;
+    struct timespec now_rt;
+    // CLOCK_MONOTONIC time that the timers and deadlines are anchored to
+    struct timespec mono;
+} evm_clock_t;
+
+// loop statistics
+typedef struct {
+    uint64_t nwait;
+    uint64_t nevent;
+    // number of timer expirations that shared a wakeup with another timer
+    uint64_t ncoalesced;
+    // number of the expired deadlines of the readable and writable events
+    uint64_t ntimedout;
+    // number of the zero-timeout waits of the busy-poll, the events found by
+    // them, and the time spent in nanoseconds
+    uint64_t nspin;
+    uint64_t nspin_event;
+    uint64_t spin_nsec;
+    // number of the additional waits to collect the minimum batch
+    uint64_t nbatch;
+    // number of the events carried over to the next iteration by the budget
+    uint64_t ncarried;
+    // number of the posted objects
+    uint64_t nposted;
+    // number of the idle gc runs, the completed gc cycles by them, the time
+    // spent in nanoseconds, and the freed memory in kilobytes
+    uint64_t ngcidle;
+    uint64_t ngccycle;
+    uint64_t gcidle_nsec;
+    uint64_t gcidle_kb;
+    // number of the iterations dispatched with the collector slowed down
+    uint64_t ngcslow;
+} evm_stats_t;
+
+// pause of the collector while dispatching the events in slow mode. a new
+// collection cycle does not start until the memory in use grows 10 times.
+#define EVM_IDLEGC_SLOWPAUSE 1000
+
+// incremental gc steps before blocking in the wait
+typedef struct {
+    // step size in kilobytes. 0 means disabled
+    int kb;
+    // maximum time of the steps in nanoseconds
+    lua_Integer nsec;
+    // slow down the collector while dispatching the events
+    int slow;
+    // collector is slowed down by the loop, and the pause to restore
+    int slowed;
+    int pause;
+} evm_idlegc_t;
+
+// queue of the objects posted by m:post
+typedef struct {
+    // pairs of the references of the posted object and context
+    int *refs;
+    int head;
+    int len;
+    int size;
+    // number of the posted objects to deliver in the current iteration
+    int nready;
+} evm_postq_t;
+
+// hooks around the blocking wait
+enum {
+    // run just before the wait
+    EVM_HOOK_PREPARE = 0,
+    // run right after the wait
+    EVM_HOOK_CHECK,
+    // run if no events occurred
+    EVM_HOOK_IDLE,
+    EVM_HOOK_NKIND
+};
+
+typedef struct {
+    int id;
+    // references of the function and context. fn is LUA_NOREF if removed
+    int fn;
+    int ctx;
+} evm_hook_t;
+
+typedef struct {
+    evm_hook_t *list;
+    int len;
+    int size;
+} evm_hooks_t;
+
+// dispatch budget for each iteration of m:wait and m:getevent
+typedef struct {
+    // maximum number of events and time in nanoseconds. 0 means unlimited
+    int nevent;
+    lua_Integer nsec;
+    // number of the delivered events and the start time of the iteration
+    int ndelivered;
+    lua_Integer start;
+} evm_budget_t;
+
+// busy-poll before blocking in the wait
+typedef struct {
+    // maximum budget of the spin in nanoseconds. 0 means disabled
+    lua_Integer max;
+    // moving average of the time until the events occur in nanoseconds
+    lua_Integer avg;
+} evm_busypoll_t;
+
+// binary min-heap of the events ordered by deadline
+typedef struct {
+    int len;
+    int size;
+    evm_ev_t **evs;
+} evm_deadlines_t;
+
 struct evm_st {
     int fd;
     int nbuf;
     int nreg;
     int nevt;
+    // number of the new events other than the timers at the bottom of the
+    // events, that are delivered after the expired deadlines
+    int nrest;
+    // maximum number of the events to collect by a wait. 0 means unlimited
+    int maxevt;
+    // list of the registered events
+    evm_ev_t *regs;
     sigset_t signals;
     fdset_t fds;
     kevt_t *evs;
+    // completion queue of the pool jobs
+    evm_cq_t *cq;
+    evm_stats_t stats;
+    evm_clock_t clock;
+    // default slack of the timers in milliseconds
+    lua_Integer slack;
+    // seed of the timer jitter
+    unsigned int seed;
+    // number of the timer events in the current batch
+    int ntimer;
+    evm_deadlines_t deadlines;
+    evm_busypoll_t busypoll;
+    // dispatch the events in priority order if any priority is set
+    int prioritized;
+    // rotation of the events within the same priority
+    unsigned int rotation;
+    // buffer to sort the events
+    kevt_t *sorted;
+    int nsorted;
+    evm_budget_t budget;
+    evm_postq_t postq;
+    evm_hooks_t hooks[EVM_HOOK_NKIND];
+    evm_idlegc_t idlegc;
+    // last id of the hooks
+    int hookid;
+    // depth of the running hooks
+    int nhookrun;
+#if defined(EVM_USE_INOTIFY)
+    evm_inotify_t inotify;
+#endif
 };
 
 // memory alloc/dealloc
@@ -73,12 +249,25 @@ lua_pushfstring(L, tname ": %p", lua_touserdata(L, 1));                        \
      })
 
 // define module names
-#define EVM_MT          "evm"
-#define EVM_EVENT_MT    "evm.event"
-#define EVM_READABLE_MT "evm.readable"
-#define EVM_WRITABLE_MT "evm.writable"
-#define EVM_TIMER_MT    "evm.timer"
-#define EVM_SIGNAL_MT   "evm.signal"
+#define EVM_MT           "evm"
+#define EVM_EVENT_MT     "evm.event"
+#define EVM_READABLE_MT  "evm.readable"
+#define EVM_WRITABLE_MT  "evm.writable"
+#define EVM_TIMER_MT     "evm.timer"
+#define EVM_SIGNAL_MT    "evm.signal"
+#define EVM_DATAGRAM_MT  "evm.datagram"
+#define EVM_PROC_MT      "evm.proc"
+#define EVM_WATCHPATH_MT "evm.watchpath"
+#define EVM_POOL_MT      "evm.pool"
+#define EVM_JOB_MT       "evm.job"
+#define EVM_GROUP_MT     "evm.group"
+#define EVM_INBOX_MT     "evm.inbox"
+#define EVM_HANDOFF_MT   "evm.handoff"
+#define EVM_CLUSTER_MT   "evm.cluster"
+#define EVM_CHANNEL_MT   "evm.channel"
+#define EVM_MESSAGE_MT   "evm.message"
+#define EVM_LOOP_MT      "evm.loop"
+#define EVM_EVGROUP_MT   "evm.evgroup"
 
 // define prototypes
 LUALIB_API int luaopen_evm(lua_State *L);
@@ -87,6 +276,46 @@ LUALIB_API int luaopen_evm_readable(lua_State *L);
 LUALIB_API int luaopen_evm_writable(lua_State *L);
 LUALIB_API int luaopen_evm_timer(lua_State *L);
 LUALIB_API int luaopen_evm_signal(lua_State *L);
+LUALIB_API int luaopen_evm_datagram(lua_State *L);
+LUALIB_API int luaopen_evm_proc(lua_State *L);
+LUALIB_API int luaopen_evm_watchpath(lua_State *L);
+LUALIB_API int luaopen_evm_pool(lua_State *L);
+LUALIB_API int luaopen_evm_job(lua_State *L);
+LUALIB_API int luaopen_evm_group(lua_State *L);
+LUALIB_API int luaopen_evm_handoff(lua_State *L);
+LUALIB_API int luaopen_evm_cluster(lua_State *L);
+LUALIB_API int luaopen_evm_channel(lua_State *L);
+LUALIB_API int luaopen_evm_message(lua_State *L);
+LUALIB_API int luaopen_evm_loop(lua_State *L);
+LUALIB_API int luaopen_evm_evgroup(lua_State *L);
+
+// implemented at evm.c
+int evm_new_lua(lua_State *L);
+int evm_loop_pushresult(lua_State *L, evm_ev_t *e);
+// implemented at cluster.c
+int evm_cluster_new_lua(lua_State *L);
+// implemented at evgroup.c
+int evm_evgroup_new_lua(lua_State *L);
+
+// readiness mask of the occurred event
+enum {
+    EVM_REV_READ  = 0x1,
+    EVM_REV_WRITE = 0x2,
+    EVM_REV_HUP   = 0x4,
+    EVM_REV_ERR   = 0x8
+};
+
+// path watch event mask
+enum {
+    EVM_WATCH_MODIFY      = 0x01,
+    EVM_WATCH_ATTRIB      = 0x02,
+    EVM_WATCH_CREATE      = 0x04,
+    EVM_WATCH_DELETE      = 0x08,
+    EVM_WATCH_MOVE        = 0x10,
+    EVM_WATCH_DELETE_SELF = 0x20,
+    EVM_WATCH_MOVE_SELF   = 0x40,
+    EVM_WATCH_ALL         = 0x7f
+};
 
 // helper functions
 
@@ -119,7 +348,7 @@ static inline int evm_define_mt(lua_State *L, const char *tname,
     return 1;
 }
 
-static inline int evm_increase_evs(evm_t *s, uint8_t incr)
+static inline int evm_increase_evs(evm_t *s, int incr)
 {
     // no buffer
     if ((INT_MAX - s->nreg - incr) <= 0) {
@@ -140,6 +369,256 @@ static inline int evm_increase_evs(evm_t *s, uint8_t incr)
     return 0;
 }
 
+// update the cached loop time
+static inline void evm_update_now(evm_t *s)
+{
+    clock_gettime(CLOCK_MONOTONIC, &s->clock.mono);
+    if (s->clock.coarse) {
+        clock_gettime(EVM_CLOCK_MONOTONIC_COARSE, &s->clock.now);
+        clock_gettime(EVM_CLOCK_REALTIME_COARSE, &s->clock.now_rt);
+    } else {
+        s->clock.now = s->clock.mono;
+        clock_gettime(CLOCK_REALTIME, &s->clock.now_rt);
+    }
+}
+
+// calculate the first expiration time of the timer from the cached loop
+// time. if slack is greater than 0, the expiration time is rounded up to a
+// multiple of slack so that the timers within the same window expire at once,
+// or it is delayed randomly within slack if jitter is specified.
+// timeout is specified in nanoseconds, and slack in milliseconds.
+static inline struct timespec evm_timer_deadline(evm_t *s, lua_Integer timeout,
+                                                 lua_Integer slack, int jitter)
+{
+    uint64_t ns = (uint64_t)s->clock.mono.tv_sec * 1000000000 +
+                  (uint64_t)s->clock.mono.tv_nsec + (uint64_t)timeout;
+
+    if (slack > 0) {
+        uint64_t window = (uint64_t)slack * 1000000;
+
+        if (jitter) {
+            ns += (uint64_t)(rand_r(&s->seed) % slack) * 1000000;
+        } else {
+            ns += window - 1;
+            ns -= ns % window;
+        }
+    }
+
+    return (struct timespec){.tv_sec  = (time_t)(ns / 1000000000),
+                             .tv_nsec = (long)(ns % 1000000000)};
+}
+
+static inline lua_Number evm_timespec2sec(struct timespec *ts)
+{
+    return (lua_Number)ts->tv_sec + (lua_Number)ts->tv_nsec / 1000000000;
+}
+
+static inline lua_Integer evm_timespec2nsec(struct timespec *ts)
+{
+    return (lua_Integer)ts->tv_sec * 1000000000 + (lua_Integer)ts->tv_nsec;
+}
+
+static inline struct timespec evm_nsec2timespec(lua_Integer nsec)
+{
+    return (struct timespec){.tv_sec  = (time_t)(nsec / 1000000000),
+                             .tv_nsec = (long)(nsec % 1000000000)};
+}
+
+// convert the fractional milliseconds to nanoseconds
+static inline lua_Integer evm_msec2nsec(lua_Number msec)
+{
+    return (lua_Integer)(msec * 1000000 + (msec < 0 ? -0.5 : 0.5));
+}
+
+// push nanoseconds as milliseconds. it is an integer if it has no fraction.
+static inline void evm_pushmsec(lua_State *L, lua_Integer nsec)
+{
+    if (nsec % 1000000) {
+        lua_pushnumber(L, (lua_Number)nsec / 1000000);
+    } else {
+        lua_pushinteger(L, nsec / 1000000);
+    }
+}
+
+// push the empty event object
+static inline evm_ev_t *evm_ev_alloc(lua_State *L, evm_t *s)
+{
+    evm_ev_t *e = lua_newuserdata(L, sizeof(evm_ev_t));
+
+    *e = (evm_ev_t){
+        .s       = s,
+        .ctx     = LUA_NOREF,
+        .ref     = LUA_NOREF,
+        .loopref = LUA_NOREF,
+        .didx    = -1,
+    };
+    // set metatable
+    lauxh_setmetatable(L, EVM_EVENT_MT);
+
+    return e;
+}
+
+// MARK: deadline heap
+
+static inline void evm_deadline_place(evm_deadlines_t *h, int i, evm_ev_t *e)
+{
+    h->evs[i] = e;
+    e->didx   = i;
+}
+
+static inline void evm_deadline_up(evm_deadlines_t *h, int i)
+{
+    evm_ev_t *e = h->evs[i];
+
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (h->evs[parent]->deadline <= e->deadline) {
+            break;
+        }
+        evm_deadline_place(h, i, h->evs[parent]);
+        i = parent;
+    }
+    evm_deadline_place(h, i, e);
+}
+
+static inline void evm_deadline_down(evm_deadlines_t *h, int i)
+{
+    evm_ev_t *e = h->evs[i];
+
+    for (;;) {
+        int child = i * 2 + 1;
+        if (child >= h->len) {
+            break;
+        } else if (child + 1 < h->len &&
+                   h->evs[child + 1]->deadline < h->evs[child]->deadline) {
+            child++;
+        }
+        if (e->deadline <= h->evs[child]->deadline) {
+            break;
+        }
+        evm_deadline_place(h, i, h->evs[child]);
+        i = child;
+    }
+    evm_deadline_place(h, i, e);
+}
+
+// remove the deadline of the event
+static inline void evm_deadline_del(evm_ev_t *e)
+{
+    evm_deadlines_t *h = &e->s->deadlines;
+    int i              = e->didx;
+
+    if (i == -1) {
+        return;
+    }
+    e->didx = -1;
+    if (--h->len > i) {
+        evm_deadline_place(h, i, h->evs[h->len]);
+        evm_deadline_up(h, i);
+        evm_deadline_down(h, i);
+    }
+}
+
+// set the deadline of the event in nanoseconds from the cached loop time
+static inline int evm_deadline_set(evm_ev_t *e, lua_Integer nsec)
+{
+    evm_deadlines_t *h = &e->s->deadlines;
+
+    e->deadline = evm_timespec2nsec(&e->s->clock.mono) + nsec;
+    if (e->didx != -1) {
+        evm_deadline_up(h, e->didx);
+        evm_deadline_down(h, e->didx);
+        return 0;
+    } else if (h->len == h->size) {
+        int size       = h->size ? h->size * 2 : 16;
+        evm_ev_t **evs = prealloc((size_t)size, evm_ev_t *, h->evs);
+
+        if (!evs) {
+            return -1;
+        }
+        h->evs  = evs;
+        h->size = size;
+    }
+    evm_deadline_place(h, h->len++, e);
+    evm_deadline_up(h, e->didx);
+
+    return 0;
+}
+
+// nanoseconds until the earliest deadline, or -1 if no deadline is set
+static inline lua_Integer evm_deadline_next(evm_t *s)
+{
+    struct timespec now;
+    lua_Integer nsec = 0;
+
+    if (!s->deadlines.len) {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    nsec = s->deadlines.evs[0]->deadline - evm_timespec2nsec(&now);
+
+    return (nsec > 0) ? nsec : 0;
+}
+
+// count the expired deadlines in the subtree of the heap
+static inline int evm_deadline_nexpired(evm_deadlines_t *h, int i,
+                                        lua_Integer now)
+{
+    if (i >= h->len || h->evs[i]->deadline > now) {
+        return 0;
+    }
+    return 1 + evm_deadline_nexpired(h, i * 2 + 1, now) +
+           evm_deadline_nexpired(h, i * 2 + 2, now);
+}
+
+// take the event whose deadline has expired at the cached loop time
+static inline evm_ev_t *evm_deadline_getev(evm_t *s)
+{
+    evm_deadlines_t *h = &s->deadlines;
+    evm_ev_t *e        = NULL;
+
+    if (h->len && h->evs[0]->deadline <= evm_timespec2nsec(&s->clock.mono)) {
+        e = h->evs[0];
+        evm_deadline_del(e);
+        s->stats.ntimedout++;
+    }
+
+    return e;
+}
+
+// add the event to the list of the registered events
+static inline void evm_ev_link(evm_ev_t *e)
+{
+    evm_t *s = e->s;
+
+    e->prev = NULL;
+    e->next = s->regs;
+    if (s->regs) {
+        s->regs->prev = e;
+    }
+    s->regs = e;
+    s->nreg++;
+}
+
+// remove the event from the list of the registered events
+static inline void evm_ev_unlink(evm_ev_t *e)
+{
+    evm_t *s = e->s;
+
+    if (e->prev) {
+        e->prev->next = e->next;
+    } else if (s->regs == e) {
+        s->regs = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    }
+    e->prev = e->next = NULL;
+    s->nreg--;
+    // deadline is cancelled by unregistration
+    evm_deadline_del(e);
+}
+
 static inline int evm_retain_context(lua_State *L, int idx)
 {
     int ctx = lauxh_refat(L, idx);
@@ -172,6 +651,14 @@ static inline int evm_asa_lua(lua_State *L, const char *mt)
         lua_pushliteral(L, "assignal");
         return 1;
 
+    case EVFILT_PROC:
+        lua_pushliteral(L, "asproc");
+        return 1;
+
+    case EVFILT_VNODE:
+        lua_pushliteral(L, "aswatchpath");
+        return 1;
+
         // unknown event
     default:
         lua_pushnil(L);
@@ -179,6 +666,37 @@ static inline int evm_asa_lua(lua_State *L, const char *mt)
     }
 }
 
+// reap the exited child process. returns -1 if not a child of this process
+static inline int evm_proc_reap(pid_t pid)
+{
+    int status = 0;
+    pid_t rv   = 0;
+
+    while ((rv = waitpid(pid, &status, WNOHANG)) == -1 && errno == EINTR) {
+        continue;
+    }
+
+    return (rv == pid) ? status : -1;
+}
+
+// push exit code and signal number of the process exit status
+static inline int evm_proc_pushstatus(lua_State *L, int status)
+{
+    if (status != -1 && WIFEXITED(status)) {
+        lua_pushinteger(L, WEXITSTATUS(status));
+        lua_pushnil(L);
+    } else if (status != -1 && WIFSIGNALED(status)) {
+        lua_pushnil(L);
+        lua_pushinteger(L, WTERMSIG(status));
+    } else {
+        // exit status of non-child process is unknown
+        lua_pushnil(L);
+        lua_pushnil(L);
+    }
+
+    return 2;
+}
+
 static inline int evm_ev_context_lua(lua_State *L, const char *mt)
 {
     evm_ev_t *e = luaL_checkudata(L, 1, mt);
@@ -213,8 +731,64 @@ static inline int evm_ev_context_lua(lua_State *L, const char *mt)
     return 1;
 }
 
+// set the deadline in milliseconds, or cancel it if nil
+static inline int evm_ev_deadline_lua(lua_State *L, const char *mt)
+{
+    evm_ev_t *e      = luaL_checkudata(L, 1, mt);
+    lua_Integer nsec = 0;
+
+    if (lua_isnoneornil(L, 2)) {
+        evm_deadline_del(e);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    nsec = evm_msec2nsec(lauxh_checknumber(L, 2));
+    if (nsec <= 0) {
+        return luaL_argerror(L, 2, "deadline must be greater than 0 msec");
+    } else if (!lauxh_isref(e->ref)) {
+        // deadline is only available while the event is registered
+        errno = ENOENT;
+    } else if (evm_deadline_set(e, nsec) == 0) {
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    // got error
+    lua_pushboolean(L, 0);
+    lua_errno_new(L, errno, "deadline");
+    return 2;
+}
+
+// number of the priority levels
+#define EVM_PRIO_MAX 8
+
+static inline int evm_ev_priority_lua(lua_State *L, const char *mt)
+{
+    evm_ev_t *e = luaL_checkudata(L, 1, mt);
+
+    if (!lua_isnoneornil(L, 2)) {
+        lua_Integer prio = lauxh_checkinteger(L, 2);
+
+        if (prio < 0 || prio >= EVM_PRIO_MAX) {
+            return luaL_argerror(L, 2, "priority value range must be 0 to 7");
+        }
+        e->prio = (int)prio;
+        if (prio) {
+            e->s->prioritized = 1;
+        }
+    }
+    lua_pushinteger(L, e->prio);
+
+    return 1;
+}
+
 static inline int evm_ev_revert_lua(lua_State *L)
 {
+    evm_ev_t *e = lua_touserdata(L, 1);
+
+    // forget the last occurred event, such as the hangup
+    memset(&e->evt, 0, sizeof(kevt_t));
     lua_settop(L, 1);
     // set event metatable
     lauxh_setmetatable(L, EVM_EVENT_MT);
@@ -224,4 +798,15 @@ static inline int evm_ev_revert_lua(lua_State *L)
 // implemented at <epoll or kqueue>/common.c
 int evm_ev_gc_lua(lua_State *L);
 
+// datagram batching
+#include "evm_dgram.h"
+// worker thread pool
+#include "evm_pool.h"
+// loop thread group
+#include "evm_group.h"
+// shared-memory channel between processes
+#include "evm_channel.h"
+// export and import of the registered events
+#include "evm_export.h"
+
 #endif
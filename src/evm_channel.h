@@ -0,0 +1,256 @@
+/**
+ *  Copyright (C) 2026 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  evm_channel.h
+ *  lua-evm
+ */
+
+#ifndef evm_channel_h
+#define evm_channel_h
+
+#include "evm_doorbell.h"
+#include <sys/mman.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+
+// default capacity of the channel in bytes
+#define EVM_CHANNEL_SIZE    65536
+// minimum capacity of the channel in bytes
+#define EVM_CHANNEL_MINSIZE 64
+// maximum capacity of the channel in bytes
+#define EVM_CHANNEL_MAXSIZE (1U << 30)
+
+// size of the length header of the message
+#define EVM_CHANNEL_HDRLEN  sizeof(uint32_t)
+// size of the message record aligned to the length header
+#define evm_chan_reclen(len)                                                   \
+ (((uint32_t)EVM_CHANNEL_HDRLEN + (len) + (uint32_t)EVM_CHANNEL_HDRLEN - 1) &  \
+  ~((uint32_t)EVM_CHANNEL_HDRLEN - 1))
+
+// single-producer single-consumer ring buffer of the messages placed in the
+// memory shared between the processes
+typedef struct {
+    uint32_t mask;
+    // producer has been closed
+    int closed;
+    // consumer waits for the doorbell
+    int armed;
+    uint64_t sent;
+    uint64_t rung;
+    uint64_t received;
+    uint64_t batches;
+    char pad0[EVM_CACHELINE];
+    // consumer position
+    uint32_t head;
+    char pad1[EVM_CACHELINE];
+    // producer position
+    uint32_t tail;
+    char pad2[EVM_CACHELINE];
+    unsigned char data[];
+} evm_chring_t;
+
+// process-local handle of the channel
+typedef struct evm_chan_st {
+    int refcnt;
+    // doorbell descriptors are inherited by the forked processes
+    evm_doorbell_t db;
+    size_t len;
+    evm_chring_t *ring;
+} evm_chan_t;
+
+// implemented at channel.c
+int evm_channel_new_lua(lua_State *L);
+
+static inline evm_chan_t *evm_chan_new(uint32_t size)
+{
+    evm_chan_t *ch = palloc(evm_chan_t);
+    uint32_t cap   = EVM_CHANNEL_MINSIZE;
+
+    // round up to power of 2
+    while (cap < size) {
+        cap <<= 1;
+    }
+    if (ch) {
+        *ch = (evm_chan_t){
+            .refcnt = 1,
+            .len    = sizeof(evm_chring_t) + cap,
+        };
+        ch->ring = mmap(NULL, ch->len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (ch->ring != MAP_FAILED) {
+            if (evm_doorbell_open(&ch->db) == 0) {
+                // mapped memory is zero-filled
+                ch->ring->mask  = cap - 1;
+                ch->ring->armed = 1;
+                return ch;
+            }
+            munmap(ch->ring, ch->len);
+        }
+        pdealloc(ch);
+    }
+
+    return NULL;
+}
+
+static inline void evm_chan_retain(evm_chan_t *ch)
+{
+    ch->refcnt++;
+}
+
+static inline void evm_chan_release(evm_chan_t *ch)
+{
+    if (ch && --ch->refcnt == 0) {
+        evm_doorbell_close(&ch->db);
+        munmap(ch->ring, ch->len);
+        pdealloc(ch);
+    }
+}
+
+static inline uint32_t evm_chan_len(evm_chring_t *r)
+{
+    return __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+}
+
+// copy the bytes into the ring at the position (producer)
+static inline void evm_chan_write(evm_chring_t *r, uint32_t pos,
+                                  const void *src, uint32_t len)
+{
+    uint32_t off = pos & r->mask;
+    uint32_t n   = r->mask + 1 - off;
+
+    if (n >= len) {
+        memcpy(r->data + off, src, len);
+    } else {
+        memcpy(r->data + off, src, n);
+        memcpy(r->data, (const char *)src + n, len - n);
+    }
+}
+
+// push the message at the position as a string (consumer)
+static inline void evm_chan_pushmsg(lua_State *L, evm_chring_t *r,
+                                    uint32_t pos, uint32_t len)
+{
+    uint32_t off = pos & r->mask;
+    uint32_t n   = r->mask + 1 - off;
+
+    if (n >= len) {
+        lua_pushlstring(L, (const char *)r->data + off, len);
+    } else {
+        lua_pushlstring(L, (const char *)r->data + off, n);
+        lua_pushlstring(L, (const char *)r->data, len - n);
+        lua_concat(L, 2);
+    }
+}
+
+// write the messages, and publish them at once (producer).
+// returns the number of written messages.
+static inline int evm_chan_send(evm_chan_t *ch, const char **msgs,
+                                size_t *lens, int nmsg)
+{
+    evm_chring_t *r = ch->ring;
+    uint32_t cap    = r->mask + 1;
+    uint32_t tail   = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    uint32_t head   = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    int i           = 0;
+
+    if (__atomic_load_n(&r->closed, __ATOMIC_ACQUIRE)) {
+        errno = EPIPE;
+        return -1;
+    }
+    for (; i < nmsg; i++) {
+        uint32_t len = (uint32_t)lens[i];
+
+        if (lens[i] > cap - EVM_CHANNEL_HDRLEN) {
+            errno = EMSGSIZE;
+            break;
+        } else if (cap - (tail - head) < evm_chan_reclen(len)) {
+            errno = EAGAIN;
+            break;
+        }
+        // the aligned length header never straddles the end of the ring
+        memcpy(r->data + (tail & r->mask), &len, EVM_CHANNEL_HDRLEN);
+        evm_chan_write(r, tail + EVM_CHANNEL_HDRLEN, msgs[i], len);
+        tail += evm_chan_reclen(len);
+    }
+    if (!i) {
+        return -1;
+    }
+
+    __atomic_store_n(&r->tail, tail, __ATOMIC_SEQ_CST);
+    r->sent += (uint64_t)i;
+    // ring the doorbell only if the consumer is waiting for it; that is the
+    // transition from empty to non-empty
+    if (__atomic_exchange_n(&r->armed, 0, __ATOMIC_SEQ_CST)) {
+        evm_doorbell_ring(&ch->db);
+        r->rung++;
+    }
+
+    return i;
+}
+
+static inline void evm_chan_close(evm_chan_t *ch)
+{
+    __atomic_store_n(&ch->ring->closed, 1, __ATOMIC_SEQ_CST);
+    evm_doorbell_ring(&ch->db);
+}
+
+// push the received messages as a table (consumer)
+static inline int evm_chan_pushresult(lua_State *L, evm_ev_t *e)
+{
+    evm_chring_t *r = e->chan->ring;
+    uint32_t head   = r->head;
+    int i           = 0;
+    int closed      = 0;
+
+    // load the closed flag first; the messages sent before the close are
+    // drained by the following loop
+    closed = __atomic_load_n(&r->closed, __ATOMIC_ACQUIRE);
+    evm_doorbell_drain(&e->chan->db);
+    lua_newtable(L);
+    for (;;) {
+        uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+        while (head != tail) {
+            uint32_t len = 0;
+
+            memcpy(&len, r->data + (head & r->mask), EVM_CHANNEL_HDRLEN);
+            evm_chan_pushmsg(L, r, head + EVM_CHANNEL_HDRLEN, len);
+            lua_rawseti(L, -2, ++i);
+            head += evm_chan_reclen(len);
+        }
+        __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+
+        // arm the doorbell and check again to not miss the sent one
+        __atomic_store_n(&r->armed, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) == head) {
+            break;
+        }
+    }
+    r->received += (uint64_t)i;
+    r->batches++;
+    lua_pushboolean(L, closed);
+
+    return 2;
+}
+
+#endif
@@ -0,0 +1,590 @@
+/**
+ *  Copyright (C) 2026 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  evm_dgram.h
+ *  lua-evm
+ */
+
+#ifndef evm_dgram_h
+#define evm_dgram_h
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+// maximum payload size of a datagram slot
+#define EVM_DGRAM_PKTSIZE    65536
+// default payload size of a datagram slot, that fits the ethernet MTU
+#define EVM_DGRAM_DEFPKTSIZE 1500
+// maximum number of datagrams per batch
+#define EVM_DGRAM_MAXBATCH   1024
+
+#if defined(UDP_SEGMENT)
+// maximum number of segments and bytes per GSO send
+# define EVM_DGRAM_GSOSEGS  64
+# define EVM_DGRAM_GSOBYTES 65507
+#endif
+
+#if !HAVE_STRUCT_MMSGHDR
+struct mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+#endif
+
+typedef union {
+    char buf[CMSG_SPACE(sizeof(uint16_t))];
+    struct cmsghdr align;
+} evm_dgram_cmsg_t;
+
+typedef struct evm_dgram_st {
+    int nmsg;
+    int nrecv;
+    int nsend;
+    int gso;
+    // payload size of each slot
+    size_t pktsize;
+    // number of the slots filled by the last receive, including the dropped
+    // datagrams
+    int nfill;
+    // receive slots
+    struct mmsghdr *rmsg;
+    struct iovec *riov;
+    struct sockaddr_storage *raddr;
+    // send queue allocated at the first send
+    struct mmsghdr *smsg;
+    struct iovec *siov;
+    struct sockaddr_storage *saddr;
+    socklen_t *slen;
+    int *srun;
+    evm_dgram_cmsg_t *sctl;
+} evm_dgram_t;
+
+#define EVM_DGRAM_ALIGN(n) (((n) + 15) & ~(size_t)15)
+
+static inline void evm_dgram_free(evm_dgram_t *d)
+{
+    // each of the receive slots and the send queue is allocated as a single
+    // block
+    pdealloc(d->smsg);
+    pdealloc(d);
+}
+
+static inline evm_dgram_t *evm_dgram_alloc(int fd, int nmsg, size_t pktsize)
+{
+    size_t nhdr    = EVM_DGRAM_ALIGN(sizeof(evm_dgram_t));
+    size_t nmh     = EVM_DGRAM_ALIGN(sizeof(struct mmsghdr) * nmsg);
+    size_t niov    = EVM_DGRAM_ALIGN(sizeof(struct iovec) * nmsg);
+    size_t nss     = EVM_DGRAM_ALIGN(sizeof(struct sockaddr_storage) * nmsg);
+    char *p        = malloc(nhdr + nmh + niov + nss + pktsize * nmsg);
+    evm_dgram_t *d = (evm_dgram_t *)p;
+
+    if (!d) {
+        return NULL;
+    }
+
+    *d = (evm_dgram_t){
+        .nmsg    = nmsg,
+        .pktsize = pktsize,
+    };
+    p += nhdr;
+    d->rmsg = (struct mmsghdr *)p;
+    p += nmh;
+    d->riov = (struct iovec *)p;
+    p += niov;
+    d->raddr = (struct sockaddr_storage *)p;
+    p += nss;
+
+    // bind receive slots to the arena
+    memset(d->rmsg, 0, sizeof(struct mmsghdr) * nmsg);
+    for (int i = 0; i < nmsg; i++) {
+        d->riov[i] = (struct iovec){
+            .iov_base = p,
+            .iov_len  = pktsize,
+        };
+        d->rmsg[i].msg_hdr = (struct msghdr){
+            .msg_name    = &d->raddr[i],
+            .msg_namelen = sizeof(struct sockaddr_storage),
+            .msg_iov     = &d->riov[i],
+            .msg_iovlen  = 1,
+        };
+        p += pktsize;
+    }
+
+#if defined(UDP_SEGMENT)
+    // coalesce queued datagrams with UDP GSO if the socket is a UDP socket
+    {
+        int proto     = 0;
+        socklen_t len = sizeof(proto);
+
+        d->gso = getsockopt(fd, SOL_SOCKET, SO_PROTOCOL, &proto, &len) == 0 &&
+                 proto == IPPROTO_UDP;
+    }
+#else
+    (void)fd;
+#endif
+
+    return d;
+}
+
+// allocate the send queue at the first send, so that the receive-only
+// sockets do not pay for it
+static inline int evm_dgram_sendq(evm_dgram_t *d)
+{
+    int nmsg    = d->nmsg;
+    size_t nmh  = EVM_DGRAM_ALIGN(sizeof(struct mmsghdr) * nmsg);
+    size_t niov = EVM_DGRAM_ALIGN(sizeof(struct iovec) * nmsg);
+    size_t nss  = EVM_DGRAM_ALIGN(sizeof(struct sockaddr_storage) * nmsg);
+    size_t nctl = EVM_DGRAM_ALIGN(sizeof(evm_dgram_cmsg_t) * nmsg);
+    size_t nlen = EVM_DGRAM_ALIGN(sizeof(socklen_t) * nmsg);
+    size_t nrun = EVM_DGRAM_ALIGN(sizeof(int) * nmsg);
+    char *p     = NULL;
+
+    if (d->smsg) {
+        return 0;
+    } else if (!(p = malloc(nmh + niov + nss + nctl + nlen + nrun +
+                            d->pktsize * nmsg))) {
+        return -1;
+    }
+
+    d->smsg = (struct mmsghdr *)p;
+    p += nmh;
+    d->siov = (struct iovec *)p;
+    p += niov;
+    d->saddr = (struct sockaddr_storage *)p;
+    p += nss;
+    d->sctl = (evm_dgram_cmsg_t *)p;
+    p += nctl;
+    d->slen = (socklen_t *)p;
+    p += nlen;
+    d->srun = (int *)p;
+    p += nrun;
+    for (int i = 0; i < nmsg; i++) {
+        d->siov[i].iov_base = p;
+        d->siov[i].iov_len  = 0;
+        p += d->pktsize;
+    }
+
+    return 0;
+}
+
+static inline int evm_dgram_recvmmsg(int fd, struct mmsghdr *msgs, int nmsg)
+{
+#if HAVE_RECVMMSG
+    return recvmmsg(fd, msgs, nmsg, MSG_DONTWAIT, NULL);
+#else
+    int n = 0;
+
+    for (; n < nmsg; n++) {
+        ssize_t len = recvmsg(fd, &msgs[n].msg_hdr, MSG_DONTWAIT);
+
+        if (len == -1) {
+            return n ? n : -1;
+        }
+        msgs[n].msg_len = (unsigned int)len;
+    }
+
+    return n;
+#endif
+}
+
+static inline int evm_dgram_sendmmsg(int fd, struct mmsghdr *msgs, int nmsg)
+{
+#if HAVE_SENDMMSG
+    return sendmmsg(fd, msgs, nmsg, MSG_DONTWAIT);
+#else
+    int n = 0;
+
+    for (; n < nmsg; n++) {
+        ssize_t len = sendmsg(fd, &msgs[n].msg_hdr, MSG_DONTWAIT);
+
+        if (len == -1) {
+            return n ? n : -1;
+        }
+        msgs[n].msg_len = (unsigned int)len;
+    }
+
+    return n;
+#endif
+}
+
+// receive up to nmsg datagrams into the arena with a single syscall. the
+// datagrams truncated to the slot size are dropped
+static inline int evm_dgram_recv(evm_dgram_t *d, int fd)
+{
+    int n = 0;
+
+    d->nrecv = 0;
+    do {
+        // reset the slots that were filled by the previous call
+        for (int i = 0; i < d->nfill; i++) {
+            d->rmsg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+            d->rmsg[i].msg_hdr.msg_flags   = 0;
+        }
+        d->nfill = 0;
+
+        if ((n = evm_dgram_recvmmsg(fd, d->rmsg, d->nmsg)) == -1) {
+            switch (errno) {
+            case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+            case EWOULDBLOCK:
+#endif
+            case EINTR:
+                return 0;
+            default:
+                return -1;
+            }
+        }
+        d->nfill = n;
+
+        // move the datagrams that fit in the slot to the head
+        for (int i = 0; i < n; i++) {
+            struct mmsghdr *dst = &d->rmsg[d->nrecv];
+            struct mmsghdr *src = &d->rmsg[i];
+
+            if (src->msg_hdr.msg_flags & MSG_TRUNC) {
+                continue;
+            } else if (dst != src) {
+                void *base = d->riov[d->nrecv].iov_base;
+
+                d->riov[d->nrecv].iov_base = d->riov[i].iov_base;
+                d->riov[i].iov_base        = base;
+                d->raddr[d->nrecv]         = d->raddr[i];
+                dst->msg_len               = src->msg_len;
+                dst->msg_hdr.msg_namelen   = src->msg_hdr.msg_namelen;
+            }
+            d->nrecv++;
+        }
+        // receive again if all of the datagrams were dropped
+    } while (n > 0 && !d->nrecv);
+
+    return d->nrecv;
+}
+
+#if defined(UDP_SEGMENT)
+// returns the number of queued datagrams that can be sent as one GSO send
+static inline int evm_dgram_gsorun(evm_dgram_t *d, int i)
+{
+    size_t seglen = d->siov[i].iov_len;
+    size_t total  = seglen;
+    int n         = 1;
+
+    while (seglen && i + n < d->nsend && n < EVM_DGRAM_GSOSEGS) {
+        int j      = i + n;
+        size_t len = d->siov[j].iov_len;
+
+        if (!len || len > seglen || total + len > EVM_DGRAM_GSOBYTES ||
+            d->slen[j] != d->slen[i] ||
+            memcmp(&d->saddr[j], &d->saddr[i], d->slen[i]) != 0) {
+            break;
+        }
+        total += len;
+        n++;
+        // only the last segment can be shorter than the segment size
+        if (len < seglen) {
+            break;
+        }
+    }
+
+    return n;
+}
+#endif
+
+// send queued datagrams and returns the number of datagrams sent
+static inline int evm_dgram_flush(evm_dgram_t *d, int fd)
+{
+    int nmsg  = 0;
+    int nsent = 0;
+    int rv    = 0;
+
+RETRY:
+    nmsg = 0;
+    for (int i = 0; i < d->nsend;) {
+        int n = 1;
+
+#if defined(UDP_SEGMENT)
+        if (d->gso) {
+            n = evm_dgram_gsorun(d, i);
+        }
+#endif
+        d->smsg[nmsg].msg_hdr = (struct msghdr){
+            .msg_name    = d->slen[i] ? &d->saddr[i] : NULL,
+            .msg_namelen = d->slen[i],
+            .msg_iov     = &d->siov[i],
+            .msg_iovlen  = n,
+        };
+#if defined(UDP_SEGMENT)
+        if (n > 1) {
+            struct msghdr *hdr = &d->smsg[nmsg].msg_hdr;
+            struct cmsghdr *cm = NULL;
+
+            hdr->msg_control    = d->sctl[nmsg].buf;
+            hdr->msg_controllen = sizeof(d->sctl[nmsg].buf);
+            cm                  = CMSG_FIRSTHDR(hdr);
+            cm->cmsg_level      = IPPROTO_UDP;
+            cm->cmsg_type       = UDP_SEGMENT;
+            cm->cmsg_len        = CMSG_LEN(sizeof(uint16_t));
+            *(uint16_t *)CMSG_DATA(cm) = (uint16_t)d->siov[i].iov_len;
+        }
+#endif
+        d->srun[nmsg++] = n;
+        i += n;
+    }
+
+    if (nmsg == 0) {
+        return 0;
+    } else if ((rv = evm_dgram_sendmmsg(fd, d->smsg, nmsg)) == -1) {
+        switch (errno) {
+        case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+        case EWOULDBLOCK:
+#endif
+        case EINTR:
+            return 0;
+        }
+        // kernel refused the segmentation offload
+        if (d->gso && d->srun[0] > 1) {
+            d->gso = 0;
+            goto RETRY;
+        }
+        return -1;
+    }
+
+    // count datagrams that were sent
+    for (int i = 0; i < rv; i++) {
+        nsent += d->srun[i];
+    }
+    // move the remaining datagrams to the head of the queue
+    for (int i = nsent; i < d->nsend; i++) {
+        int j = i - nsent;
+
+        memcpy(d->siov[j].iov_base, d->siov[i].iov_base, d->siov[i].iov_len);
+        d->siov[j].iov_len = d->siov[i].iov_len;
+        d->saddr[j]        = d->saddr[i];
+        d->slen[j]         = d->slen[i];
+    }
+    d->nsend -= nsent;
+
+    return nsent;
+}
+
+// convert host and port to sockaddr. returns 0 for connected sockets
+static inline int evm_dgram_toaddr(struct sockaddr_storage *ss,
+                                   socklen_t *len, const char *host,
+                                   int port)
+{
+    struct sockaddr_in *in   = (struct sockaddr_in *)ss;
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)ss;
+    struct sockaddr_un *un   = (struct sockaddr_un *)ss;
+
+    memset(ss, 0, sizeof(struct sockaddr_storage));
+    if (!host) {
+        *len = 0;
+        return 0;
+    }
+    // pathname of unix domain socket
+    else if (port < 0) {
+        size_t plen = strlen(host);
+
+        if (plen >= sizeof(un->sun_path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, host, plen);
+        *len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + plen + 1);
+        return 0;
+    } else if (inet_pton(AF_INET, host, &in->sin_addr) == 1) {
+        in->sin_family = AF_INET;
+        in->sin_port   = htons((uint16_t)port);
+        *len           = sizeof(struct sockaddr_in);
+        return 0;
+    } else if (inet_pton(AF_INET6, host, &in6->sin6_addr) == 1) {
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port   = htons((uint16_t)port);
+        *len             = sizeof(struct sockaddr_in6);
+        return 0;
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+// push host and port of sockaddr. returns number of pushed values
+static inline int evm_dgram_pushaddr(lua_State *L, struct sockaddr_storage *ss,
+                                     socklen_t len)
+{
+    char buf[INET6_ADDRSTRLEN];
+
+    if (len == 0) {
+        return 0;
+    }
+
+    switch (ss->ss_family) {
+    case AF_INET: {
+        struct sockaddr_in *in = (struct sockaddr_in *)ss;
+
+        lua_pushstring(L, inet_ntop(AF_INET, &in->sin_addr, buf, sizeof(buf)));
+        lua_pushinteger(L, ntohs(in->sin_port));
+        return 2;
+    }
+
+    case AF_INET6: {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)ss;
+
+        lua_pushstring(L,
+                       inet_ntop(AF_INET6, &in6->sin6_addr, buf, sizeof(buf)));
+        lua_pushinteger(L, ntohs(in6->sin6_port));
+        return 2;
+    }
+
+    case AF_UNIX: {
+        struct sockaddr_un *un = (struct sockaddr_un *)ss;
+
+        // unnamed socket
+        if (len <= offsetof(struct sockaddr_un, sun_path) || !*un->sun_path) {
+            return 0;
+        }
+        lua_pushstring(L, un->sun_path);
+        return 1;
+    }
+
+    default:
+        return 0;
+    }
+}
+
+// MARK: lua methods for evm.datagram
+
+static inline int evm_dgram_len_lua(lua_State *L, const char *mt)
+{
+    evm_ev_t *e = luaL_checkudata(L, 1, mt);
+
+    lua_pushinteger(L, e->dgram->nrecv);
+    return 1;
+}
+
+static inline int evm_dgram_recv_lua(lua_State *L, const char *mt)
+{
+    evm_ev_t *e = luaL_checkudata(L, 1, mt);
+
+    if (evm_dgram_recv(e->dgram, evm_ev_fd(e)) == -1) {
+        lua_pushnil(L);
+        lua_errno_new(L, errno, "recv");
+        return 2;
+    }
+    lua_pushinteger(L, e->dgram->nrecv);
+    return 1;
+}
+
+static inline int evm_dgram_packet_lua(lua_State *L, const char *mt)
+{
+    evm_ev_t *e         = luaL_checkudata(L, 1, mt);
+    lua_Integer idx     = lauxh_checkinteger(L, 2);
+    evm_dgram_t *d      = e->dgram;
+    struct mmsghdr *msg = NULL;
+
+    if (idx < 1 || idx > d->nrecv) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    msg = &d->rmsg[idx - 1];
+    lua_pushlstring(L, d->riov[idx - 1].iov_base, msg->msg_len);
+    return 1 + evm_dgram_pushaddr(L, &d->raddr[idx - 1],
+                                  msg->msg_hdr.msg_namelen);
+}
+
+static inline int evm_dgram_flush_lua(lua_State *L, const char *mt)
+{
+    evm_ev_t *e    = luaL_checkudata(L, 1, mt);
+    evm_dgram_t *d = e->dgram;
+    int nsend      = d->nsend;
+    int n          = evm_dgram_flush(d, evm_ev_fd(e));
+
+    if (n == -1) {
+        lua_pushinteger(L, 0);
+        lua_errno_new(L, errno, "flush");
+        return 2;
+    }
+
+    lua_pushinteger(L, n);
+    // some datagrams remain in the queue
+    if (n < nsend) {
+        lua_pushnil(L);
+        lua_pushboolean(L, 1);
+        return 3;
+    }
+    return 1;
+}
+
+static inline int evm_dgram_sendto_lua(lua_State *L, const char *mt)
+{
+    evm_ev_t *e      = luaL_checkudata(L, 1, mt);
+    size_t len       = 0;
+    const char *msg  = luaL_checklstring(L, 2, &len);
+    const char *host = luaL_optlstring(L, 3, NULL, NULL);
+    int port         = (int)lauxh_optinteger(L, 4, -1);
+    evm_dgram_t *d   = e->dgram;
+    int idx          = 0;
+
+    if (port > 65535) {
+        return luaL_argerror(L, 4, "port value range must be 0 to 65535");
+    } else if (len > d->pktsize) {
+        errno = EMSGSIZE;
+        goto FAILED;
+    } else if (evm_dgram_sendq(d) == -1) {
+        goto FAILED;
+    }
+
+    // flush the queue if full
+    if (d->nsend == d->nmsg) {
+        if (evm_dgram_flush(d, evm_ev_fd(e)) == -1) {
+            goto FAILED;
+        } else if (d->nsend == d->nmsg) {
+            lua_pushboolean(L, 0);
+            lua_pushnil(L);
+            lua_pushboolean(L, 1);
+            return 3;
+        }
+    }
+
+    idx = d->nsend;
+    if (evm_dgram_toaddr(&d->saddr[idx], &d->slen[idx], host, port) == -1) {
+        goto FAILED;
+    }
+    memcpy(d->siov[idx].iov_base, msg, len);
+    d->siov[idx].iov_len = len;
+    d->nsend++;
+    lua_pushboolean(L, 1);
+    return 1;
+
+FAILED:
+    lua_pushboolean(L, 0);
+    lua_errno_new(L, errno, "sendto");
+    return 2;
+}
+
+#endif
@@ -0,0 +1,108 @@
+/**
+ *  Copyright (C) 2026 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  evm_doorbell.h
+ *  lua-evm
+ */
+
+#ifndef evm_doorbell_h
+#define evm_doorbell_h
+
+#include <fcntl.h>
+#if HAVE_SYS_EVENTFD_H
+# include <sys/eventfd.h>
+#endif
+
+// wakeup descriptor rung by the other threads or processes.
+// eventfd is used if available, otherwise a pipe.
+typedef struct {
+    int rfd;
+    int wfd;
+} evm_doorbell_t;
+
+static inline int evm_doorbell_open(evm_doorbell_t *db)
+{
+#if HAVE_SYS_EVENTFD_H
+    if ((db->rfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) != -1) {
+        db->wfd = db->rfd;
+        return 0;
+    }
+#else
+    int fds[2];
+
+    if (pipe(fds) == 0) {
+        int i = 0;
+
+        for (; i < 2; i++) {
+            fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        }
+        db->rfd = fds[0];
+        db->wfd = fds[1];
+        return 0;
+    }
+#endif
+
+    return -1;
+}
+
+static inline void evm_doorbell_close(evm_doorbell_t *db)
+{
+    close(db->rfd);
+    if (db->wfd != db->rfd) {
+        close(db->wfd);
+    }
+    db->rfd = db->wfd = -1;
+}
+
+static inline void evm_doorbell_ring(evm_doorbell_t *db)
+{
+#if HAVE_SYS_EVENTFD_H
+    uint64_t v = 1;
+#else
+    char v = 1;
+#endif
+
+    // EAGAIN means the doorbell is already rung
+    while (write(db->wfd, &v, sizeof(v)) == -1 && errno == EINTR) {
+    }
+}
+
+static inline void evm_doorbell_drain(evm_doorbell_t *db)
+{
+    char buf[64];
+
+    for (;;) {
+        ssize_t n = read(db->rfd, buf, sizeof(buf));
+
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+#if !HAVE_SYS_EVENTFD_H
+        else if (n > 0) {
+            continue;
+        }
+#endif
+        break;
+    }
+}
+
+#endif
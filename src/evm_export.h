@@ -0,0 +1,81 @@
+/**
+ *  Copyright (C) 2026 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *
+ *  evm_export.h
+ *  lua-evm
+ */
+
+#ifndef evm_export_h
+#define evm_export_h
+
+#include <sys/socket.h>
+
+// number of the events sent by a single sendmsg
+#define EVM_EXPORT_NBATCH 64
+// magic number of the export message
+#define EVM_EXPORT_MAGIC  0x45564d31
+
+// type of the exported event
+enum {
+    EVM_EXPORT_READABLE = 1,
+    EVM_EXPORT_WRITABLE,
+    EVM_EXPORT_DATAGRAM,
+    EVM_EXPORT_TIMER,
+    EVM_EXPORT_SIGNAL
+};
+
+// flags of the exported event
+#define EVM_EXPORT_ONESHOT 0x1
+#define EVM_EXPORT_EDGE    0x2
+
+// attributes of the exported event
+typedef struct {
+    uint8_t type;
+    uint8_t flags;
+    // batch size and slot size of the datagram event
+    uint16_t nmsg;
+    uint32_t pktsize;
+    // signal number or timer period in nanoseconds
+    int64_t ident;
+    // remaining time of the timer in nanoseconds
+    int64_t remain;
+} evm_export_t;
+
+// export message: a header followed by the events. the descriptors of the
+// events are sent as the ancillary data in the same order.
+typedef struct {
+    uint32_t magic;
+    uint16_t nrec;
+    // last message of the export
+    uint16_t last;
+} evm_exphdr_t;
+
+typedef struct {
+    evm_exphdr_t hdr;
+    evm_export_t recs[EVM_EXPORT_NBATCH];
+} evm_expmsg_t;
+
+// implemented at export.c
+int evm_export_lua(lua_State *L);
+int evm_import_lua(lua_State *L);
+
+#endif
@@ -0,0 +1,171 @@
+/**
+ *  Copyright (C) 2026 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  evm_group.h
+ *  lua-evm
+ */
+
+#ifndef evm_group_h
+#define evm_group_h
+
+#include "evm_doorbell.h"
+#include <pthread.h>
+#if HAVE_SCHED_H
+# include <sched.h>
+#endif
+
+// default capacity of the inbox of each loop thread
+#define EVM_INBOX_SIZE       1024
+// maximum number of loop threads
+#define EVM_GROUP_MAXTHREADS 1024
+
+#define EVM_CACHELINE 64
+
+// lock-free single-producer single-consumer queue of descriptors handed off
+// to a loop thread
+typedef struct evm_inbox_st {
+    int refcnt;
+    evm_doorbell_t db;
+    // group has been closed
+    int closed;
+    // number of registered events reported by the consumer
+    int load;
+    uint64_t sent;
+    uint32_t mask;
+    // consumer waits for the doorbell
+    int armed;
+    char pad0[EVM_CACHELINE];
+    // consumer position
+    uint32_t head;
+    char pad1[EVM_CACHELINE];
+    // producer position
+    uint32_t tail;
+    char pad2[EVM_CACHELINE];
+    int fds[];
+} evm_inbox_t;
+
+// implemented at group.c
+int evm_group_new_lua(lua_State *L);
+
+static inline evm_inbox_t *evm_inbox_new(uint32_t size)
+{
+    evm_inbox_t *ib = NULL;
+    uint32_t cap    = 1;
+
+    // round up to power of 2
+    while (cap < size) {
+        cap <<= 1;
+    }
+    ib = calloc(1, sizeof(evm_inbox_t) + sizeof(int) * cap);
+    if (ib) {
+        if (evm_doorbell_open(&ib->db) == 0) {
+            ib->refcnt = 1;
+            ib->mask   = cap - 1;
+            ib->armed  = 1;
+            return ib;
+        }
+        pdealloc(ib);
+    }
+
+    return NULL;
+}
+
+static inline void evm_inbox_retain(evm_inbox_t *ib)
+{
+    __atomic_add_fetch(&ib->refcnt, 1, __ATOMIC_RELAXED);
+}
+
+static inline void evm_inbox_release(evm_inbox_t *ib)
+{
+    if (ib && __atomic_sub_fetch(&ib->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        // close the descriptors that have not been received
+        for (; ib->head != ib->tail; ib->head++) {
+            close(ib->fds[ib->head & ib->mask]);
+        }
+        evm_doorbell_close(&ib->db);
+        pdealloc(ib);
+    }
+}
+
+static inline uint32_t evm_inbox_len(evm_inbox_t *ib)
+{
+    return __atomic_load_n(&ib->tail, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&ib->head, __ATOMIC_ACQUIRE);
+}
+
+// push the descriptor (producer)
+static inline int evm_inbox_push(evm_inbox_t *ib, int fd)
+{
+    uint32_t tail = __atomic_load_n(&ib->tail, __ATOMIC_RELAXED);
+
+    if (tail - __atomic_load_n(&ib->head, __ATOMIC_ACQUIRE) > ib->mask) {
+        errno = EAGAIN;
+        return -1;
+    }
+    ib->fds[tail & ib->mask] = fd;
+    __atomic_store_n(&ib->tail, tail + 1, __ATOMIC_SEQ_CST);
+    ib->sent++;
+
+    // ring the doorbell only if the consumer is waiting for it
+    if (__atomic_exchange_n(&ib->armed, 0, __ATOMIC_SEQ_CST)) {
+        evm_doorbell_ring(&ib->db);
+    }
+    return 0;
+}
+
+static inline void evm_inbox_close(evm_inbox_t *ib)
+{
+    __atomic_store_n(&ib->closed, 1, __ATOMIC_SEQ_CST);
+    evm_doorbell_ring(&ib->db);
+}
+
+// push the received descriptors as a table (consumer)
+static inline int evm_inbox_pushresult(lua_State *L, evm_ev_t *e)
+{
+    evm_inbox_t *ib = e->inbox;
+    uint32_t head   = ib->head;
+    int i           = 0;
+
+    // update load for the placement policy
+    __atomic_store_n(&ib->load, e->s->nreg, __ATOMIC_RELAXED);
+    evm_doorbell_drain(&ib->db);
+    lua_newtable(L);
+    for (;;) {
+        uint32_t tail = __atomic_load_n(&ib->tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++) {
+            lua_pushinteger(L, ib->fds[head & ib->mask]);
+            lua_rawseti(L, -2, ++i);
+        }
+        __atomic_store_n(&ib->head, head, __ATOMIC_RELEASE);
+
+        // arm the doorbell and check again to not miss the pushed one
+        __atomic_store_n(&ib->armed, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ib->tail, __ATOMIC_SEQ_CST) == head) {
+            break;
+        }
+    }
+    lua_pushboolean(L, __atomic_load_n(&ib->closed, __ATOMIC_ACQUIRE));
+
+    return 2;
+}
+
+#endif
@@ -0,0 +1,342 @@
+/**
+ *  Copyright (C) 2026 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  evm_pool.h
+ *  lua-evm
+ */
+
+#ifndef evm_pool_h
+#define evm_pool_h
+
+#include "evm_doorbell.h"
+#include <netdb.h>
+#include <pthread.h>
+
+// default number of worker threads and depth of the submission queue
+#define EVM_POOL_NTHREADS   4
+#define EVM_POOL_QDEPTH     1024
+// maximum number of worker threads
+#define EVM_POOL_MAXTHREADS 1024
+
+// built-in blocking jobs
+enum {
+    EVM_JOB_FILEREAD = 0,
+    EVM_JOB_FILEWRITE,
+    EVM_JOB_FSYNC,
+    EVM_JOB_GETADDRINFO
+};
+
+typedef struct evm_job_st {
+    // owned by the event object and by the pool until delivered
+    int refcnt;
+    struct evm_job_st *next;
+    // completion queue of the submitter
+    evm_cq_t *cq;
+    // event object, or NULL if the job has been detached
+    evm_ev_t *e;
+    int op;
+    int fd;
+    // file offset, or -1 to use the file position
+    off_t offset;
+    size_t len;
+    // read buffer or data to write
+    char *buf;
+    char *host;
+    char *service;
+    struct addrinfo *ai;
+    // results
+    ssize_t rc;
+    int err;
+    // completion has been delivered to the loop thread
+    int done;
+} evm_job_t;
+
+// completion queue of evm_t.
+// worker threads push the completed jobs onto the lock-free stack, and ring
+// the doorbell only on the empty to non-empty transition.
+struct evm_cq_st {
+    int refcnt;
+    evm_job_t *head;
+    // completed jobs in submission order (loop thread only)
+    evm_job_t *ready;
+    evm_job_t *tail;
+    evm_doorbell_t db;
+    // event descriptor that the doorbell is registered to
+    int epfd;
+};
+
+// shared by the pool object and the worker threads, and freed by the last
+// one that releases it
+typedef struct {
+    int refcnt;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int shutdown;
+    int nthreads;
+    pthread_t *threads;
+    // bounded submission queue
+    size_t qdepth;
+    size_t qhead;
+    size_t nqueue;
+    evm_job_t **queue;
+    // stats
+    size_t nrunning;
+    size_t peak;
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t saturated;
+} evm_pool_t;
+
+// implemented at pool.c
+int evm_pool_submit(evm_pool_t *p, evm_job_t *job);
+int evm_pool_new_lua(lua_State *L);
+
+static inline evm_job_t *evm_job_new(int op, int fd)
+{
+    evm_job_t *job = pcalloc(evm_job_t);
+
+    if (job) {
+        job->refcnt = 1;
+        job->op     = op;
+        job->fd     = fd;
+        job->offset = -1;
+    }
+    return job;
+}
+
+static inline void evm_job_retain(evm_job_t *job)
+{
+    __atomic_add_fetch(&job->refcnt, 1, __ATOMIC_RELAXED);
+}
+
+static inline void evm_job_release(evm_job_t *job)
+{
+    if (__atomic_sub_fetch(&job->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        pdealloc(job->buf);
+        pdealloc(job->host);
+        pdealloc(job->service);
+        if (job->ai) {
+            freeaddrinfo(job->ai);
+        }
+        pdealloc(job);
+    }
+}
+
+// detach the job from the event object
+static inline void evm_job_detach(evm_ev_t *e)
+{
+    if (e->job) {
+        e->job->e = NULL;
+        evm_job_release(e->job);
+        e->job = NULL;
+    }
+}
+
+// MARK: completion queue
+
+static inline evm_cq_t *evm_cq_new(void)
+{
+    evm_cq_t *cq = pcalloc(evm_cq_t);
+
+    if (!cq) {
+        return NULL;
+    }
+    cq->refcnt = 1;
+    cq->epfd   = -1;
+    if (evm_doorbell_open(&cq->db) == 0) {
+        return cq;
+    }
+    pdealloc(cq);
+    return NULL;
+}
+
+static inline void evm_cq_retain(evm_cq_t *cq)
+{
+    __atomic_add_fetch(&cq->refcnt, 1, __ATOMIC_RELAXED);
+}
+
+static inline void evm_cq_release(evm_cq_t *cq)
+{
+    if (cq && __atomic_sub_fetch(&cq->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        evm_job_t *lists[2] = {cq->head, cq->ready};
+        int i               = 0;
+
+        for (; i < 2; i++) {
+            while (lists[i]) {
+                evm_job_t *job = lists[i];
+
+                lists[i] = job->next;
+                evm_job_release(job);
+            }
+        }
+        evm_doorbell_close(&cq->db);
+        pdealloc(cq);
+    }
+}
+
+// push the completed job (worker thread)
+static inline void evm_cq_push(evm_cq_t *cq, evm_job_t *job)
+{
+    evm_job_t *head = __atomic_load_n(&cq->head, __ATOMIC_RELAXED);
+
+    do {
+        job->next = head;
+    } while (!__atomic_compare_exchange_n(&cq->head, &head, job, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    // ring the doorbell if the queue was empty
+    if (!head) {
+        evm_doorbell_ring(&cq->db);
+    }
+    evm_cq_release(cq);
+}
+
+// move the completed jobs to the ready list (loop thread)
+static inline void evm_cq_take(evm_cq_t *cq)
+{
+    evm_job_t *job  = NULL;
+    evm_job_t *list = NULL;
+
+    // drain the doorbell before taking the jobs to not lose a ring
+    evm_doorbell_drain(&cq->db);
+
+    // reverse the stack into submission order
+    job = __atomic_exchange_n(&cq->head, NULL, __ATOMIC_ACQUIRE);
+    while (job) {
+        evm_job_t *next = job->next;
+
+        job->next = list;
+        list      = job;
+        job       = next;
+    }
+    if (list) {
+        if (cq->tail) {
+            cq->tail->next = list;
+        } else {
+            cq->ready = list;
+        }
+        for (job = list; job->next; job = job->next) {
+        }
+        cq->tail = job;
+    }
+}
+
+// number of the completed jobs taken but not delivered yet
+static inline int evm_cq_nready(evm_cq_t *cq)
+{
+    evm_job_t *job = cq ? cq->ready : NULL;
+    int n          = 0;
+
+    for (; job; job = job->next) {
+        n++;
+    }
+    return n;
+}
+
+// deliver the completed job
+static inline evm_ev_t *evm_cq_getev(evm_t *s, int *isdel)
+{
+    evm_cq_t *cq = s->cq;
+    evm_ev_t *e  = NULL;
+
+    while (cq && cq->ready) {
+        evm_job_t *job = cq->ready;
+
+        if (!(cq->ready = job->next)) {
+            cq->tail = NULL;
+        }
+        job->next = NULL;
+        job->done = 1;
+        // event object has been detached
+        if (!job->e) {
+            evm_job_release(job);
+            continue;
+        }
+        // job event always disabled after delivery
+        *isdel = 1;
+        e      = job->e;
+        evm_job_release(job);
+        return e;
+    }
+
+    return NULL;
+}
+
+// push the results of the job
+static inline int evm_job_pushresult(lua_State *L, evm_job_t *job)
+{
+    if (job->err) {
+        lua_pushnil(L);
+        switch (job->op) {
+        case EVM_JOB_FILEREAD:
+            lua_errno_new(L, job->err, "read");
+            break;
+        case EVM_JOB_FILEWRITE:
+            lua_errno_new(L, job->err, "write");
+            break;
+        case EVM_JOB_FSYNC:
+            lua_errno_new(L, job->err, "fsync");
+            break;
+        default:
+            lua_errno_new(L, job->err, "getaddrinfo");
+        }
+        return 2;
+    }
+
+    switch (job->op) {
+    case EVM_JOB_FILEREAD:
+        lua_pushlstring(L, job->buf, (size_t)job->rc);
+        return 1;
+
+    case EVM_JOB_FILEWRITE:
+        lua_pushinteger(L, job->rc);
+        return 1;
+
+    case EVM_JOB_FSYNC:
+        lua_pushboolean(L, 1);
+        return 1;
+
+    default: {
+        struct addrinfo *ai = job->ai;
+        char addr[INET6_ADDRSTRLEN];
+        int i = 0;
+
+        // list of numeric addresses
+        lua_newtable(L);
+        for (; ai; ai = ai->ai_next) {
+            void *src = (ai->ai_family == AF_INET6) ?
+                            (void *)&((struct sockaddr_in6 *)ai->ai_addr)
+                                ->sin6_addr :
+                            (void *)&((struct sockaddr_in *)ai->ai_addr)
+                                ->sin_addr;
+
+            if ((ai->ai_family == AF_INET || ai->ai_family == AF_INET6) &&
+                inet_ntop(ai->ai_family, src, addr, sizeof(addr))) {
+                lua_pushstring(L, addr);
+                lua_rawseti(L, -2, ++i);
+            }
+        }
+        return 1;
+    }
+    }
+}
+
+#endif
@@ -0,0 +1,411 @@
+/**
+ *  Copyright (C) 2026 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *
+ *  export.c
+ *  lua-evm
+ */
+
+#include "evm_event.h"
+
+#if !defined(MSG_CMSG_CLOEXEC)
+# define MSG_CMSG_CLOEXEC 0
+#endif
+
+// control buffer to pass the descriptors of a batch
+typedef union {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(int) * EVM_EXPORT_NBATCH)];
+} evm_expctl_t;
+
+static int export_send(int sock, evm_expmsg_t *msg, int *fds, int nfd)
+{
+    evm_expctl_t ctl;
+    struct iovec iov = {
+        .iov_base = msg,
+        .iov_len  = sizeof(evm_exphdr_t) + sizeof(evm_export_t) * msg->hdr.nrec,
+    };
+    struct msghdr mh = {
+        .msg_iov    = &iov,
+        .msg_iovlen = 1,
+    };
+
+    if (nfd) {
+        struct cmsghdr *cmsg = NULL;
+
+        mh.msg_control    = ctl.buf;
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfd);
+        cmsg              = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level  = SOL_SOCKET;
+        cmsg->cmsg_type   = SCM_RIGHTS;
+        cmsg->cmsg_len    = CMSG_LEN(sizeof(int) * nfd);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfd);
+    }
+
+    while (iov.iov_len) {
+        ssize_t n = sendmsg(sock, &mh, 0);
+
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        // descriptors are sent with the first byte
+        mh.msg_control    = NULL;
+        mh.msg_controllen = 0;
+        iov.iov_base      = (char *)iov.iov_base + n;
+        iov.iov_len -= (size_t)n;
+    }
+
+    return 0;
+}
+
+int evm_export_lua(lua_State *L)
+{
+    evm_t *s       = luaL_checkudata(L, 1, EVM_MT);
+    lua_Integer sd = lauxh_checkinteger(L, 2);
+    evm_ev_t *e    = s->regs;
+    int nexp       = 0;
+    int nfd        = 0;
+    int fds[EVM_EXPORT_NBATCH];
+    evm_expmsg_t msg;
+
+    if (sd < 0 || sd > INT_MAX) {
+        return luaL_argerror(L, 2,
+                             "fd value range must be 0 to " MSTRCAT(INT_MAX));
+    }
+
+    msg.hdr = (evm_exphdr_t){.magic = EVM_EXPORT_MAGIC};
+    for (; e; e = e->next) {
+        int fd = -1;
+
+        switch (evm_ev_export(e, &msg.recs[msg.hdr.nrec], &fd)) {
+        case -1:
+            goto FAILED;
+        case 0:
+            continue;
+        }
+        if (fd != -1) {
+            fds[nfd++] = fd;
+        }
+        // send a full batch
+        if (++msg.hdr.nrec == EVM_EXPORT_NBATCH) {
+            if (export_send((int)sd, &msg, fds, nfd) == -1) {
+                goto FAILED;
+            }
+            nexp += msg.hdr.nrec;
+            msg.hdr.nrec = 0;
+            nfd          = 0;
+        }
+    }
+
+    // send the last batch
+    msg.hdr.last = 1;
+    if (export_send((int)sd, &msg, fds, nfd) == 0) {
+        lua_pushinteger(L, nexp + msg.hdr.nrec);
+        return 1;
+    }
+
+FAILED:
+    lua_pushnil(L);
+    lua_errno_new(L, errno, "export");
+    return 2;
+}
+
+// receive exactly len bytes, and the descriptors sent with them
+static ssize_t import_recv(int sock, int stream, void *buf, size_t len,
+                           int *fds, int *nfd)
+{
+    size_t total = 0;
+
+    while (total < len) {
+        evm_expctl_t ctl;
+        struct iovec iov = {
+            .iov_base = (char *)buf + total,
+            .iov_len  = len - total,
+        };
+        struct msghdr mh = {
+            .msg_iov        = &iov,
+            .msg_iovlen     = 1,
+            .msg_control    = ctl.buf,
+            .msg_controllen = sizeof(ctl.buf),
+        };
+        struct cmsghdr *cmsg = NULL;
+        ssize_t n            = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        // collect the received descriptors
+        for (cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET &&
+                cmsg->cmsg_type == SCM_RIGHTS) {
+                int nrecv = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+
+                if (*nfd + nrecv > EVM_EXPORT_NBATCH) {
+                    // close the excess descriptors
+                    int *rfds = (int *)CMSG_DATA(cmsg);
+                    int i     = 0;
+
+                    for (; i < nrecv; i++) {
+                        close(rfds[i]);
+                    }
+                    errno = EPROTO;
+                    return -1;
+                }
+                memcpy(fds + *nfd, CMSG_DATA(cmsg), sizeof(int) * nrecv);
+                *nfd += nrecv;
+            }
+        }
+
+        if (n == 0) {
+            errno = ECONNRESET;
+            return -1;
+        } else if (mh.msg_flags & MSG_CTRUNC) {
+            errno = EPROTO;
+            return -1;
+        }
+        total += (size_t)n;
+        // message of the packet socket is received at once
+        if (!stream) {
+            break;
+        }
+    }
+
+    return (ssize_t)total;
+}
+
+static int import_recvmsg(int sock, int stream, evm_expmsg_t *msg, int *fds,
+                          int *nfd)
+{
+    ssize_t len = 0;
+
+    *nfd = 0;
+    if (stream) {
+        // receive the header, then the events of the batch
+        if (import_recv(sock, 1, &msg->hdr, sizeof(evm_exphdr_t), fds, nfd) ==
+                -1 ||
+            (msg->hdr.magic == EVM_EXPORT_MAGIC &&
+             msg->hdr.nrec <= EVM_EXPORT_NBATCH &&
+             import_recv(sock, 1, msg->recs,
+                         sizeof(evm_export_t) * msg->hdr.nrec, fds,
+                         nfd) == -1)) {
+            return -1;
+        }
+        len = sizeof(evm_exphdr_t) + sizeof(evm_export_t) * msg->hdr.nrec;
+    } else if ((len = import_recv(sock, 0, msg, sizeof(evm_expmsg_t), fds,
+                                  nfd)) == -1) {
+        return -1;
+    }
+
+    // verify the message
+    if ((size_t)len < sizeof(evm_exphdr_t) ||
+        msg->hdr.magic != EVM_EXPORT_MAGIC ||
+        msg->hdr.nrec > EVM_EXPORT_NBATCH ||
+        (size_t)len !=
+            sizeof(evm_exphdr_t) + sizeof(evm_export_t) * msg->hdr.nrec) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    return 0;
+}
+
+// register the event of the record, and push it
+static int import_event(lua_State *L, evm_t *s, evm_export_t *rec, int *fds,
+                        int nfd, int *ifd)
+{
+    evm_ev_t *e    = NULL;
+    int oneshot    = rec->flags & EVM_EXPORT_ONESHOT;
+    int edge       = rec->flags & EVM_EXPORT_EDGE;
+    const char *mt = NULL;
+    int fd         = -1;
+
+    switch (rec->type) {
+    case EVM_EXPORT_READABLE:
+    case EVM_EXPORT_WRITABLE:
+    case EVM_EXPORT_DATAGRAM:
+        if (*ifd >= nfd) {
+            errno = EPROTO;
+            return -1;
+        }
+        fd = fds[(*ifd)++];
+        break;
+    }
+
+    e = evm_ev_alloc(L, s);
+    switch (rec->type) {
+    case EVM_EXPORT_READABLE:
+        if (evm_ev_as_readable(e, fd, oneshot, edge) == 0) {
+            mt = EVM_READABLE_MT;
+        }
+        break;
+
+    case EVM_EXPORT_WRITABLE:
+        if (evm_ev_as_writable(e, fd, oneshot, edge) == 0) {
+            mt = EVM_WRITABLE_MT;
+        }
+        break;
+
+    case EVM_EXPORT_DATAGRAM:
+        if (rec->nmsg < 1 || rec->nmsg > EVM_DGRAM_MAXBATCH ||
+            rec->pktsize < 1 || rec->pktsize > EVM_DGRAM_PKTSIZE) {
+            errno = EPROTO;
+        } else if (evm_ev_as_datagram(e, fd, rec->nmsg, rec->pktsize, oneshot,
+                                      edge) == 0) {
+            mt = EVM_DATAGRAM_MT;
+        }
+        break;
+
+    case EVM_EXPORT_TIMER:
+        if (rec->ident <= 0) {
+            errno = EPROTO;
+        } else if (evm_ev_as_timer(e, (lua_Integer)rec->ident, oneshot, 0,
+                                   0) == 0) {
+            mt = EVM_TIMER_MT;
+        }
+        break;
+
+    case EVM_EXPORT_SIGNAL:
+        if (rec->ident <= 0 || rec->ident >= NSIG) {
+            errno = EPROTO;
+        } else if (evm_ev_as_signal(e, (int)rec->ident, oneshot) == 0) {
+            mt = EVM_SIGNAL_MT;
+        }
+        break;
+
+    default:
+        errno = EPROTO;
+    }
+
+    if (!mt) {
+        // close the consumed descriptor
+        if (fd != -1) {
+            int err = errno;
+
+            close(fd);
+            errno = err;
+        }
+        lua_pop(L, 1);
+        return -1;
+    }
+    lauxh_setmetatable(L, mt);
+    lua_pushvalue(L, -1);
+    e->ref = lauxh_ref(L);
+
+    // continue the remaining time of the exported timer
+    if (rec->type == EVM_EXPORT_TIMER &&
+        evm_ev_set_remain(e, (lua_Integer)rec->remain) == -1) {
+        int err = errno;
+
+        lua_getfield(L, -1, "revert");
+        lua_insert(L, -2);
+        lua_call(L, 1, 0);
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+int evm_import_lua(lua_State *L)
+{
+    lua_Integer sd = lauxh_checkinteger(L, 1);
+    int stream     = 0;
+    int nevt       = 0;
+    int err        = 0;
+    int fds[EVM_EXPORT_NBATCH];
+    socklen_t len = sizeof(stream);
+    evm_expmsg_t msg;
+    evm_t *s = NULL;
+
+    if (sd < 0 || sd > INT_MAX) {
+        return luaL_argerror(L, 1,
+                             "fd value range must be 0 to " MSTRCAT(INT_MAX));
+    } else if (getsockopt((int)sd, SOL_SOCKET, SO_TYPE, &stream, &len) ==
+               -1) {
+        lua_pushnil(L);
+        lua_errno_new(L, errno, "import");
+        return 2;
+    }
+    stream = (stream == SOCK_STREAM);
+
+    // create new evm
+    lua_settop(L, 0);
+    if (evm_new_lua(L) != 1) {
+        return 2;
+    }
+    s = lua_touserdata(L, 1);
+    lua_newtable(L);
+
+    do {
+        int nfd = 0;
+        int ifd = 0;
+        int i   = 0;
+
+        if (import_recvmsg((int)sd, stream, &msg, fds, &nfd) == -1) {
+            // close the received descriptors
+            for (; ifd < nfd; ifd++) {
+                close(fds[ifd]);
+            }
+            goto FAILED;
+        }
+        for (; i < msg.hdr.nrec; i++) {
+            if (import_event(L, s, &msg.recs[i], fds, nfd, &ifd) == -1) {
+                err = errno;
+                // close the unregistered descriptors
+                for (; ifd < nfd; ifd++) {
+                    close(fds[ifd]);
+                }
+                errno = err;
+                goto FAILED;
+            }
+            lua_rawseti(L, 2, ++nevt);
+        }
+    } while (!msg.hdr.last);
+
+    return 2;
+
+FAILED:
+    err = errno;
+    // revert the imported events and close their descriptors
+    for (; nevt > 0; nevt--) {
+        int fd = -1;
+
+        lua_rawgeti(L, 2, nevt);
+        fd = evm_ev_userfd(lua_touserdata(L, -1));
+        lua_getfield(L, -1, "revert");
+        lua_insert(L, -2);
+        lua_call(L, 1, 0);
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+    lua_settop(L, 0);
+    lua_pushnil(L);
+    lua_errno_new(L, err, "import");
+    return 2;
+}
@@ -0,0 +1,479 @@
+/**
+ *  Copyright (C) 2026 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  group.c
+ *  lua-evm
+ */
+
+#include "evm_event.h"
+#include <lualib.h>
+
+typedef struct evm_group_st evm_group_t;
+
+typedef struct {
+    evm_group_t *g;
+    pthread_t tid;
+    int idx;
+    int running;
+    const char *script;
+    // package.path and package.cpath of the creator
+    const char *path;
+    const char *cpath;
+    // error message of the script
+    char *err;
+    evm_inbox_t *inbox;
+} evm_gthread_t;
+
+// shared by the group object and the loop threads, and freed by the last one
+// that releases it
+struct evm_group_st {
+    int refcnt;
+    int nthreads;
+    int closed;
+    char *script;
+    char *path;
+    char *cpath;
+    evm_gthread_t *threads;
+};
+
+static void group_release(evm_group_t *g)
+{
+    if (__atomic_sub_fetch(&g->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        int i = 0;
+
+        for (; i < g->nthreads; i++) {
+            pdealloc(g->threads[i].err);
+            evm_inbox_release(g->threads[i].inbox);
+        }
+        pdealloc(g->threads);
+        pdealloc(g->script);
+        pdealloc(g->path);
+        pdealloc(g->cpath);
+        pdealloc(g);
+    }
+}
+
+static void gthread_run(evm_gthread_t *t)
+{
+    lua_State *L     = luaL_newstate();
+    evm_inbox_t **ib = NULL;
+
+    if (!L) {
+        t->err = strdup(strerror(ENOMEM));
+        return;
+    }
+    luaL_openlibs(L);
+
+    // inherit the module search paths
+    lua_getglobal(L, "package");
+    if (t->path) {
+        lauxh_pushstr2tbl(L, "path", t->path);
+    }
+    if (t->cpath) {
+        lauxh_pushstr2tbl(L, "cpath", t->cpath);
+    }
+    lua_pop(L, 1);
+
+    // load evm module to define the metatables in this state
+    lua_getglobal(L, "require");
+    lua_pushliteral(L, "evm");
+    if (lua_pcall(L, 1, 0, 0) == 0 && luaL_loadfile(L, t->script) == 0) {
+        // call script with index and inbox
+        lua_pushinteger(L, t->idx);
+        ib = lua_newuserdata(L, sizeof(evm_inbox_t *));
+        evm_inbox_retain(t->inbox);
+        *ib = t->inbox;
+        lauxh_setmetatable(L, EVM_INBOX_MT);
+        if (lua_pcall(L, 2, 0, 0) == 0) {
+            lua_close(L);
+            return;
+        }
+    }
+    t->err = strdup(lua_tostring(L, -1) ? lua_tostring(L, -1) : "?");
+    lua_close(L);
+}
+
+static void *gthread_main(void *arg)
+{
+    evm_gthread_t *t = (evm_gthread_t *)arg;
+
+    gthread_run(t);
+    group_release(t->g);
+
+    return NULL;
+}
+
+static void group_close(evm_group_t *g)
+{
+    int i = 0;
+
+    if (!g->closed) {
+        g->closed = 1;
+        for (; i < g->nthreads; i++) {
+            evm_inbox_close(g->threads[i].inbox);
+        }
+    }
+}
+
+static void group_join(evm_group_t *g)
+{
+    int i = 0;
+
+    for (; i < g->nthreads; i++) {
+        if (g->threads[i].running) {
+            pthread_join(g->threads[i].tid, NULL);
+            g->threads[i].running = 0;
+        }
+    }
+}
+
+// the detached threads release the group when their script exits
+static void group_detach(evm_group_t *g)
+{
+    int i = 0;
+
+    for (; i < g->nthreads; i++) {
+        if (g->threads[i].running) {
+            pthread_detach(g->threads[i].tid);
+            g->threads[i].running = 0;
+        }
+    }
+}
+
+static int send_lua(lua_State *L)
+{
+    evm_group_t *g  = *(evm_group_t **)luaL_checkudata(L, 1, EVM_GROUP_MT);
+    lua_Integer fd  = lauxh_checkinteger(L, 2);
+    lua_Integer idx = lauxh_optinteger(L, 3, 0);
+    int i           = 0;
+
+    if (fd < 0 || fd > INT_MAX) {
+        return luaL_argerror(L, 2,
+                             "fd value range must be 0 to " MSTRCAT(INT_MAX));
+    } else if (idx < 0 || idx > g->nthreads) {
+        return lauxh_argerror(L, 3, "idx value range must be 1 to %d",
+                              g->nthreads);
+    } else if (g->closed) {
+        lua_pushnil(L);
+        lua_errno_new(L, EPIPE, "send");
+        return 2;
+    } else if (idx == 0) {
+        // select the least-loaded thread
+        uint64_t min = UINT64_MAX;
+
+        for (; i < g->nthreads; i++) {
+            evm_inbox_t *ib = g->threads[i].inbox;
+            uint64_t load   = (uint64_t)evm_inbox_len(ib) +
+                            (uint64_t)__atomic_load_n(&ib->load,
+                                                      __ATOMIC_RELAXED);
+
+            if (load < min) {
+                min = load;
+                idx = i + 1;
+            }
+        }
+    }
+
+    if (evm_inbox_push(g->threads[idx - 1].inbox, (int)fd) == 0) {
+        lua_pushinteger(L, idx);
+        return 1;
+    }
+
+    // got error
+    lua_pushnil(L);
+    lua_errno_new(L, errno, "send");
+    return 2;
+}
+
+static int stats_lua(lua_State *L)
+{
+    evm_group_t *g = *(evm_group_t **)luaL_checkudata(L, 1, EVM_GROUP_MT);
+    int i          = 0;
+
+    lua_createtable(L, g->nthreads, 0);
+    for (; i < g->nthreads; i++) {
+        evm_inbox_t *ib = g->threads[i].inbox;
+
+        lua_createtable(L, 0, 3);
+        lauxh_pushint2tbl(L, "queued", evm_inbox_len(ib));
+        lauxh_pushint2tbl(L, "load",
+                          __atomic_load_n(&ib->load, __ATOMIC_RELAXED));
+        lauxh_pushint2tbl(L, "sent", (lua_Integer)ib->sent);
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    return 1;
+}
+
+static int close_lua(lua_State *L)
+{
+    group_close(*(evm_group_t **)luaL_checkudata(L, 1, EVM_GROUP_MT));
+    return 0;
+}
+
+static int join_lua(lua_State *L)
+{
+    evm_group_t *g = *(evm_group_t **)luaL_checkudata(L, 1, EVM_GROUP_MT);
+    int nerr       = 0;
+    int i          = 0;
+
+    group_join(g);
+    // returns the error messages of the scripts
+    lua_createtable(L, g->nthreads, 0);
+    for (; i < g->nthreads; i++) {
+        if (g->threads[i].err) {
+            lua_pushstring(L, g->threads[i].err);
+            lua_rawseti(L, -2, i + 1);
+            nerr++;
+        }
+    }
+    if (!nerr) {
+        lua_pushnil(L);
+    }
+
+    return 1;
+}
+
+static int gc_lua(lua_State *L)
+{
+    evm_group_t **g = lua_touserdata(L, 1);
+
+    // do not wait for the loop threads that have not been joined
+    if (*g) {
+        group_close(*g);
+        group_detach(*g);
+        group_release(*g);
+        *g = NULL;
+    }
+
+    return 0;
+}
+
+static int tostring_lua(lua_State *L)
+{
+    return TOSTRING_MT(L, EVM_GROUP_MT);
+}
+
+static int setaffinity(pthread_attr_t *attr, int cpu)
+{
+#if HAVE_PTHREAD_ATTR_SETAFFINITY_NP
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+#else
+    (void)attr;
+    (void)cpu;
+    return ENOTSUP;
+#endif
+}
+
+// duplicate the string field of the package table
+static char *dupfield(lua_State *L, const char *k)
+{
+    char *v = NULL;
+
+    lua_getglobal(L, "package");
+    if (lua_istable(L, -1)) {
+        lua_getfield(L, -1, k);
+        if (lua_type(L, -1) == LUA_TSTRING) {
+            v = strdup(lua_tostring(L, -1));
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+
+    return v;
+}
+
+int evm_group_new_lua(lua_State *L)
+{
+    int argc             = lua_gettop(L);
+    lua_Integer nthreads = lauxh_checkinteger(L, 1);
+    const char *script   = lauxh_checkstring(L, 2);
+    lua_Integer qsize    = EVM_INBOX_SIZE;
+    long ncpu            = 0;
+    evm_group_t **gg     = NULL;
+    evm_group_t *g       = NULL;
+    sigset_t all, old;
+    int rc = 0;
+
+    // check arguments
+    if (argc > 4) {
+        argc = 4;
+    }
+    switch (argc) {
+    case 4:
+        // arg#4 capacity of the inbox
+        qsize = lauxh_optinteger(L, 4, qsize);
+        if (qsize < 1 || qsize > INT32_MAX) {
+            return lauxh_argerror(L, 4, "qsize value range must be 1 to %d",
+                                  INT32_MAX);
+        }
+    case 3:
+        // arg#3 cpus to pin the threads
+        if (lua_isboolean(L, 3)) {
+            if (lua_toboolean(L, 3)) {
+                ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+            }
+        } else if (!lua_isnoneornil(L, 3)) {
+            luaL_checktype(L, 3, LUA_TTABLE);
+            for (;; ncpu++) {
+                lua_rawgeti(L, 3, ncpu + 1);
+                if (lua_isnil(L, -1)) {
+                    lua_pop(L, 1);
+                    break;
+                } else if (!lua_isnumber(L, -1) || lua_tointeger(L, -1) < 0) {
+                    return luaL_argerror(L, 3, "cpus must be a list of cpu "
+                                               "numbers");
+                }
+                lua_pop(L, 1);
+            }
+        }
+    default:
+        if (nthreads < 1 || nthreads > EVM_GROUP_MAXTHREADS) {
+            return lauxh_argerror(L, 1, "nthreads value range must be 1 to %d",
+                                  EVM_GROUP_MAXTHREADS);
+        }
+    }
+
+    gg = lua_newuserdata(L, sizeof(evm_group_t *));
+    if (!(g = pcalloc(evm_group_t)) || !(g->script = strdup(script)) ||
+        !(g->threads = pcnalloc((size_t)nthreads, evm_gthread_t))) {
+        if (g) {
+            pdealloc(g->script);
+            pdealloc(g);
+        }
+        lua_pushnil(L);
+        lua_errno_new(L, errno, "group");
+        return 2;
+    }
+    // released by the group object
+    g->refcnt = 1;
+    *gg       = g;
+    lauxh_setmetatable(L, EVM_GROUP_MT);
+    g->path  = dupfield(L, "path");
+    g->cpath = dupfield(L, "cpath");
+
+    // block all signals in loop threads to keep signals delivered to the
+    // creator thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (; g->nthreads < nthreads; g->nthreads++) {
+        evm_gthread_t *t = &g->threads[g->nthreads];
+        pthread_attr_t attr;
+
+        t->g      = g;
+        t->idx    = g->nthreads + 1;
+        t->script = g->script;
+        t->path   = g->path;
+        t->cpath  = g->cpath;
+        if (!(t->inbox = evm_inbox_new((uint32_t)qsize))) {
+            rc = errno;
+            break;
+        }
+
+        pthread_attr_init(&attr);
+        if (ncpu > 0) {
+            int cpu = g->nthreads % ncpu;
+
+            // pin to the specified cpu
+            if (lua_istable(L, 3)) {
+                lua_rawgeti(L, 3, cpu + 1);
+                cpu = (int)lua_tointeger(L, -1);
+                lua_pop(L, 1);
+            }
+            rc = setaffinity(&attr, cpu);
+        }
+        if (!rc) {
+            // released by the loop thread
+            __atomic_add_fetch(&g->refcnt, 1, __ATOMIC_RELAXED);
+            if ((rc = pthread_create(&t->tid, &attr, gthread_main, t))) {
+                group_release(g);
+            }
+        }
+        pthread_attr_destroy(&attr);
+        if (rc) {
+            // count the allocated inbox
+            g->nthreads++;
+            break;
+        }
+        t->running = 1;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (rc) {
+        // stop the created threads
+        group_close(g);
+        group_join(g);
+        lua_pushnil(L);
+        lua_errno_new(L, rc, "group");
+        return 2;
+    }
+
+    return 1;
+}
+
+// MARK: inbox object passed to the loop thread
+
+static int inbox_gc_lua(lua_State *L)
+{
+    evm_inbox_t **ib = lua_touserdata(L, 1);
+
+    evm_inbox_release(*ib);
+
+    return 0;
+}
+
+static int inbox_tostring_lua(lua_State *L)
+{
+    return TOSTRING_MT(L, EVM_INBOX_MT);
+}
+
+LUALIB_API int luaopen_evm_group(lua_State *L)
+{
+    struct luaL_Reg mmethod[] = {
+        {"__gc",       gc_lua      },
+        {"__tostring", tostring_lua},
+        {NULL,         NULL        }
+    };
+    struct luaL_Reg method[] = {
+        {"send",  send_lua },
+        {"stats", stats_lua},
+        {"close", close_lua},
+        {"join",  join_lua },
+        {NULL,    NULL     }
+    };
+    struct luaL_Reg inbox_mmethod[] = {
+        {"__gc",       inbox_gc_lua      },
+        {"__tostring", inbox_tostring_lua},
+        {NULL,         NULL              }
+    };
+    struct luaL_Reg inbox_method[] = {
+        {NULL, NULL}
+    };
+
+    evm_define_mt(L, EVM_GROUP_MT, mmethod, method);
+    evm_define_mt(L, EVM_INBOX_MT, inbox_mmethod, inbox_method);
+
+    return 0;
+}
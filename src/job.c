@@ -0,0 +1,156 @@
+/**
+ *  Copyright (C) 2026 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  job.c
+ *  lua-evm
+ */
+
+#include "evm_event.h"
+
+static int unwatch_lua(lua_State *L)
+{
+    evm_ev_t *e = luaL_checkudata(L, 1, EVM_JOB_MT);
+
+    if (lauxh_isref(e->ref)) {
+        // result of the running job will be discarded
+        evm_job_detach(e);
+        evm_ev_unlink(e);
+        e->ref = lauxh_unref(L, e->ref);
+    }
+
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+static int watch_lua(lua_State *L)
+{
+    evm_ev_t *e = luaL_checkudata(L, 1, EVM_JOB_MT);
+
+    // job cannot be resubmitted
+    if (!lauxh_isref(e->ref)) {
+        lua_pushboolean(L, 0);
+        lua_errno_new(L, EINVAL, "watch");
+        return 2;
+    }
+
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+static int context_lua(lua_State *L)
+{
+    return evm_ev_context_lua(L, EVM_JOB_MT);
+}
+
+static int asa_lua(lua_State *L)
+{
+    evm_ev_t *e = luaL_checkudata(L, 1, EVM_JOB_MT);
+
+    if (!e->job) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    switch (e->job->op) {
+    case EVM_JOB_FILEREAD:
+        lua_pushliteral(L, "asfileread");
+        return 1;
+    case EVM_JOB_FILEWRITE:
+        lua_pushliteral(L, "asfilewrite");
+        return 1;
+    case EVM_JOB_FSYNC:
+        lua_pushliteral(L, "asfsync");
+        return 1;
+    default:
+        lua_pushliteral(L, "asgetaddrinfo");
+        return 1;
+    }
+}
+
+static int ident_lua(lua_State *L)
+{
+    evm_ev_t *e = luaL_checkudata(L, 1, EVM_JOB_MT);
+
+    if (!e->job) {
+        lua_pushnil(L);
+    } else if (e->job->op == EVM_JOB_GETADDRINFO) {
+        lua_pushstring(L, e->job->host);
+    } else {
+        lua_pushinteger(L, e->job->fd);
+    }
+
+    return 1;
+}
+
+static int renew_lua(lua_State *L)
+{
+    // job is bound to the completion queue of the submitter
+    return watch_lua(L);
+}
+
+static int gc_lua(lua_State *L)
+{
+    evm_ev_t *e = lua_touserdata(L, 1);
+
+    // release job
+    evm_job_detach(e);
+    // release context
+    e->ctx = lauxh_unref(L, e->ctx);
+
+    return 0;
+}
+
+static int revert_lua(lua_State *L)
+{
+    unwatch_lua(L);
+    gc_lua(L);
+    return evm_ev_revert_lua(L);
+}
+
+static int tostring_lua(lua_State *L)
+{
+    return TOSTRING_MT(L, EVM_JOB_MT);
+}
+
+LUALIB_API int luaopen_evm_job(lua_State *L)
+{
+    struct luaL_Reg mmethod[] = {
+        {"__gc",       gc_lua      },
+        {"__tostring", tostring_lua},
+        {NULL,         NULL        }
+    };
+    struct luaL_Reg method[] = {
+        {"revert",  revert_lua },
+        {"renew",   renew_lua  },
+        {"ident",   ident_lua  },
+        {"asa",     asa_lua    },
+        {"context", context_lua},
+        {"watch",   watch_lua  },
+        {"unwatch", unwatch_lua},
+        {NULL,      NULL       }
+    };
+
+    evm_define_mt(L, EVM_JOB_MT, mmethod, method);
+
+    return 0;
+}
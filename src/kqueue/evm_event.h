@@ -29,16 +29,148 @@
 
 #include "evm.h"
 
-static inline int evm_wait(evm_t *s, lua_Integer timeout)
+static inline void evm_init(evm_t *s)
+{
+    (void)s;
+}
+
+static inline void evm_dealloc(evm_t *s)
+{
+    (void)s;
+}
+
+// create the completion queue and register its doorbell
+static inline int evm_cq_open(evm_t *s)
+{
+    if (!s->cq && !(s->cq = evm_cq_new())) {
+        return -1;
+    } else if (s->cq->epfd != s->fd) {
+        kevt_t evt;
+
+        EV_SET(&evt, (uintptr_t)s->cq->db.rfd, EVFILT_READ, EV_ADD, 0, 0, NULL);
+        if (kevent(s->fd, &evt, 1, NULL, 0, NULL) == -1) {
+            return -1;
+        }
+        s->cq->epfd = s->fd;
+    }
+
+    return 0;
+}
+
+// apply the changes in the changelist, and leave the result of each change in
+// it as a receipt that has EV_ERROR flag and the error number in data.
+// returns 0, or the error number of the first failure.
+static inline int evm_apply_changes(evm_t *s, kevt_t *chg, int nchg)
+{
+    int err = 0;
+    int i   = 0;
+
+#if defined(EV_RECEIPT)
+    int n = 0;
+
+    for (; i < nchg; i++) {
+        chg[i].flags |= EV_RECEIPT;
+    }
+    // receive the result of each change instead of the pending events
+    if ((n = kevent(s->fd, chg, nchg, chg, nchg, NULL)) == -1) {
+        return errno;
+    }
+    for (i = 0; i < n; i++) {
+        if ((chg[i].flags & EV_ERROR) && chg[i].data && !err) {
+            err = (int)chg[i].data;
+        }
+    }
+#else
+    for (; i < nchg; i++) {
+        int rc = kevent(s->fd, &chg[i], 1, NULL, 0, NULL);
+
+        chg[i].flags |= EV_ERROR;
+        chg[i].data = (rc == -1) ? errno : 0;
+        if (rc == -1 && !err) {
+            err = errno;
+        }
+    }
+#endif
+    return err;
+}
+
+// register all the registered events to the renewed event descriptor with
+// a batched changelist. returns 0, or the error number of the first failure.
+static inline int evm_reregister(evm_t *s)
+{
+    evm_ev_t *e = s->regs;
+    int nchg    = 0;
+    int err     = 0;
+    int rc      = 0;
+
+    // internal descriptor of the pool jobs
+    if (s->cq && evm_cq_open(s) == -1) {
+        err = errno;
+    }
+
+    // pending events in the event buffer are discarded
+    s->nevt  = 0;
+    s->nrest = 0;
+    for (; e; e = e->next) {
+        // job is not registered to kqueue
+        if (e->reg.filter == EVFILT_JOB) {
+            continue;
+        }
+        s->evs[nchg] = e->reg;
+        if (++nchg == s->nbuf) {
+            if ((rc = evm_apply_changes(s, s->evs, nchg)) && !err) {
+                err = rc;
+            }
+            nchg = 0;
+        }
+    }
+    if (nchg && (rc = evm_apply_changes(s, s->evs, nchg)) && !err) {
+        err = rc;
+    }
+
+    return err;
+}
+
+// wait the events into the specified buffer.
+// timeout is specified in nanoseconds
+static inline int evm_wait_into(evm_t *s, kevt_t *evs, int nevs,
+                                lua_Integer timeout)
 {
     if (timeout > -1) {
-        struct timespec ts = {.tv_sec  = timeout / 1000,
-                              .tv_nsec = (timeout % 1000) * 1000000};
+        struct timespec ts = evm_nsec2timespec(timeout);
 
-        return kevent(s->fd, NULL, 0, s->evs, (int)s->nreg, &ts);
+        return kevent(s->fd, NULL, 0, evs, nevs, &ts);
     }
 
-    return kevent(s->fd, NULL, 0, s->evs, (int)s->nreg, NULL);
+    return kevent(s->fd, NULL, 0, evs, nevs, NULL);
+}
+
+static inline int evm_wait(evm_t *s, lua_Integer timeout)
+{
+    // the rest of the events are kept in the kernel
+    int nevs = (s->maxevt && s->maxevt < s->nreg) ? s->maxevt : s->nreg;
+
+    return evm_wait_into(s, s->evs, nevs, timeout);
+}
+
+// kqueue has no busy-poll parameters of the network devices
+static inline void evm_set_busypoll(evm_t *s)
+{
+    (void)s;
+}
+
+// get the event object of the kernel event, or NULL if it is internal
+static inline evm_ev_t *evm_kevt_ev(evm_t *s, kevt_t *evt)
+{
+    (void)s;
+    return (evm_ev_t *)evt->udata;
+}
+
+// number of the events buffered in user space, that are delivered before the
+// occurred events
+static inline int evm_nbuffered(evm_t *s)
+{
+    return evm_cq_nready(s->cq);
 }
 
 static inline evm_ev_t *evm_getev(evm_t *s, int *isdel)
@@ -48,8 +180,17 @@ static inline evm_ev_t *evm_getev(evm_t *s, int *isdel)
     int delflg  = 0;
 
 CHECK_NEXT:
-    if (s->nevt > 0) {
-        evt    = &s->evs[--s->nevt];
+    // deliver the completed jobs first
+    if ((e = evm_cq_getev(s, isdel))) {
+        return e;
+    } else if (s->nevt > 0) {
+        evt = &s->evs[--s->nevt];
+        // take the completed jobs from the completion queue
+        if (s->cq && evt->filter == EVFILT_READ && !evt->udata &&
+            (int)evt->ident == s->cq->db.rfd) {
+            evm_cq_take(s->cq);
+            goto CHECK_NEXT;
+        }
         delflg = evt->flags & (EV_ONESHOT | EV_EOF | EV_ERROR);
 
         switch (evt->filter) {
@@ -74,8 +215,23 @@ CHECK_NEXT:
                 sigdelset(&s->signals, evt->ident);
             }
             break;
+        case EVFILT_PROC:
+            // process has exited: reap it. kernel removes the knote
+            evt->data = evm_proc_reap((pid_t)evt->ident);
+            delflg    = EV_ONESHOT;
+            break;
+        case EVFILT_VNODE:
+            // watched path has gone
+            if (evt->fflags & (NOTE_DELETE | NOTE_REVOKE)) {
+                delflg |= EV_EOF;
+            }
+            break;
         }
 
+        // keep the occurred flags before rewriting it to the change
+        e      = (evm_ev_t *)evt->udata;
+        e->evt = *evt;
+
         // remove from kernel event
         if (delflg) {
             *isdel = delflg;
@@ -89,9 +245,6 @@ CHECK_NEXT:
                 kevent(s->fd, evt, 1, NULL, 0, NULL);
             }
         }
-
-        e      = (evm_ev_t *)evt->udata;
-        e->evt = *evt;
     }
 
     return e;
@@ -102,7 +255,7 @@ static inline int evm_register(evm_ev_t *e)
     // increase event-buffer and set event
     if (evm_increase_evs(e->s, 1) == 0 &&
         kevent(e->s->fd, &e->reg, 1, NULL, 0, NULL) == 0) {
-        e->s->nreg++;
+        evm_ev_link(e);
         return 0;
     }
 
@@ -111,6 +264,25 @@ static inline int evm_register(evm_ev_t *e)
 
 // MARK: API for evm_ev_t
 
+// descriptor of the user watched by the event, or -1 if the event does not
+// watch the descriptor of the user
+static inline int evm_ev_userfd(evm_ev_t *e)
+{
+    // internal descriptors
+    if (e->inbox || e->chan || e->loop) {
+        return -1;
+    }
+
+    switch (e->reg.filter) {
+    case EVFILT_READ:
+    case EVFILT_WRITE:
+        return (int)e->reg.ident;
+
+    default:
+        return -1;
+    }
+}
+
 #define evm_ev_as_fd(e, fd, type, oneshot, edge)                               \
  do {                                                                          \
   /* already watched */                                                        \
@@ -139,6 +311,55 @@ static inline int evm_ev_as_readable(evm_ev_t *e, int fd, int oneshot, int edge)
     evm_ev_as_fd(e, fd, READ, oneshot, edge);
 }
 
+static inline int evm_ev_as_datagram(evm_ev_t *e, int fd, int nmsg,
+                                     size_t pktsize, int oneshot, int edge)
+{
+    evm_dgram_t *d = evm_dgram_alloc(fd, nmsg, pktsize);
+
+    if (d) {
+        if (evm_ev_as_readable(e, fd, oneshot, edge) == 0) {
+            e->dgram = d;
+            return 0;
+        }
+        evm_dgram_free(d);
+    }
+
+    return -1;
+}
+
+static inline int evm_ev_as_handoff(evm_ev_t *e, evm_inbox_t *ib)
+{
+    if (evm_ev_as_readable(e, ib->db.rfd, 0, 0) == 0) {
+        e->inbox = ib;
+        evm_inbox_retain(ib);
+        return 0;
+    }
+
+    return -1;
+}
+
+static inline int evm_ev_as_message(evm_ev_t *e, evm_chan_t *ch)
+{
+    if (evm_ev_as_readable(e, ch->db.rfd, 0, 0) == 0) {
+        e->chan = ch;
+        evm_chan_retain(ch);
+        return 0;
+    }
+
+    return -1;
+}
+
+static inline int evm_ev_as_loop(evm_ev_t *e, evm_t *child, int nevt)
+{
+    if (evm_ev_as_readable(e, child->fd, 0, 0) == 0) {
+        e->loop    = child;
+        e->loopmax = nevt;
+        return 0;
+    }
+
+    return -1;
+}
+
 static inline int evm_ev_as_signal(evm_ev_t *e, int signo, int oneshot)
 {
     // already watched
@@ -159,16 +380,243 @@ static inline int evm_ev_as_signal(evm_ev_t *e, int signo, int oneshot)
     return -1;
 }
 
-static inline int evm_ev_as_timer(evm_ev_t *e, lua_Integer timeout, int oneshot)
+static inline int evm_ev_as_proc(evm_ev_t *e, pid_t pid, int oneshot)
 {
+#if defined(NOTE_EXITSTATUS)
+    uint32_t fflags = NOTE_EXIT | NOTE_EXITSTATUS;
+#else
+    uint32_t fflags = NOTE_EXIT;
+#endif
+
+    // set event fields
+    EV_SET(&e->reg, (uintptr_t)pid, EVFILT_PROC,
+           EV_ADD | (oneshot ? EV_ONESHOT : 0), fflags, 0, (void *)e);
+
+    return evm_register(e);
+}
+
+static inline uint32_t evm_vnode_fflags(int mask)
+{
+    // changes of the directory entries are notified as NOTE_WRITE
+    return ((mask & (EVM_WATCH_MODIFY | EVM_WATCH_CREATE | EVM_WATCH_DELETE |
+                     EVM_WATCH_MOVE)) ?
+                NOTE_WRITE | NOTE_EXTEND :
+                0) |
+           ((mask & EVM_WATCH_ATTRIB) ? NOTE_ATTRIB : 0) |
+           ((mask & EVM_WATCH_DELETE_SELF) ? NOTE_DELETE | NOTE_REVOKE : 0) |
+           ((mask & EVM_WATCH_MOVE_SELF) ? NOTE_RENAME : 0);
+}
+
+static inline int evm_vnode_tomask(uint32_t fflags, int mask)
+{
+    return (((fflags & (NOTE_WRITE | NOTE_EXTEND)) ?
+                 EVM_WATCH_MODIFY | EVM_WATCH_CREATE | EVM_WATCH_DELETE |
+                     EVM_WATCH_MOVE :
+                 0) |
+            ((fflags & NOTE_ATTRIB) ? EVM_WATCH_ATTRIB : 0) |
+            ((fflags & (NOTE_DELETE | NOTE_REVOKE)) ? EVM_WATCH_DELETE_SELF :
+                                                      0) |
+            ((fflags & NOTE_RENAME) ? EVM_WATCH_MOVE_SELF : 0)) &
+           mask;
+}
+
+static inline int evm_ev_as_watchpath(evm_ev_t *e, const char *path, int mask,
+                                      int oneshot)
+{
+#if defined(O_EVTONLY)
+    int fd = open(path, O_EVTONLY | O_CLOEXEC);
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+#endif
+
+    if (fd == -1) {
+        return -1;
+    } else if ((e->path = strdup(path))) {
+        // set event fields: keep the requested mask in data field
+        EV_SET(&e->reg, (uintptr_t)fd, EVFILT_VNODE,
+               EV_ADD | EV_CLEAR | (oneshot ? EV_ONESHOT : 0),
+               evm_vnode_fflags(mask), (intptr_t)mask, (void *)e);
+        if (evm_register(e) == 0) {
+            return 0;
+        }
+        pdealloc(e->path);
+        e->path = NULL;
+    }
+    close(fd);
+
+    return -1;
+}
+
+static inline int evm_ev_as_job(evm_ev_t *e, evm_pool_t *p, evm_job_t *job)
+{
+    evm_t *s = e->s;
+
+    if (evm_cq_open(s) == -1 || evm_increase_evs(s, 1) == -1) {
+        return -1;
+    }
+
+    // set event fields: job is not registered to kqueue
+    EV_SET(&e->reg, (uintptr_t)job->fd, EVFILT_JOB, 0, 0, 0, (void *)e);
+    job->cq = s->cq;
+    job->e  = e;
+    evm_cq_retain(s->cq);
+    evm_job_retain(job);
+    if (evm_pool_submit(p, job) == 0) {
+        e->job = job;
+        evm_ev_link(e);
+        return 0;
+    }
+    evm_job_release(job);
+    evm_cq_release(s->cq);
+
+    return -1;
+}
+
+// set the period in nanoseconds with the finest unit of the platform
+static inline void evm_timer_setdata(kevt_t *reg, lua_Integer nsec)
+{
+#if defined(NOTE_NSECONDS)
+    reg->fflags = NOTE_NSECONDS;
+    reg->data   = (intptr_t)nsec;
+#elif defined(NOTE_USECONDS)
+    reg->fflags = NOTE_USECONDS;
+    reg->data   = (intptr_t)((nsec + 999) / 1000);
+#else
+    // round up to milliseconds not to expire before the period
+    reg->fflags = 0;
+    reg->data   = (intptr_t)((nsec + 999999) / 1000000);
+#endif
+}
+
+static inline lua_Integer evm_ev_timer_nsec(evm_ev_t *e)
+{
+#if defined(NOTE_NSECONDS)
+    if (e->reg.fflags & NOTE_NSECONDS) {
+        return (lua_Integer)e->reg.data;
+    }
+#endif
+#if defined(NOTE_USECONDS)
+    if (e->reg.fflags & NOTE_USECONDS) {
+        return (lua_Integer)e->reg.data * 1000;
+    }
+#endif
+    return (lua_Integer)e->reg.data * 1000000;
+}
+
+// timeout is specified in nanoseconds.
+// kqueue can not set the first expiration time independently of the period,
+// so the slack and jitter are ignored.
+static inline int evm_ev_as_timer(evm_ev_t *e, lua_Integer timeout, int oneshot,
+                                  lua_Integer slack, int jitter)
+{
+    (void)slack;
+    (void)jitter;
     // set event fields
     EV_SET(&e->reg, (uintptr_t)e, EVFILT_TIMER,
-           EV_ADD | (oneshot ? EV_ONESHOT : 0), 0, (intptr_t)timeout,
-           (void *)e);
+           EV_ADD | (oneshot ? EV_ONESHOT : 0), 0, 0, (void *)e);
+    evm_timer_setdata(&e->reg, timeout);
 
     return evm_register(e);
 }
 
+// one-shot timer that expires at the absolute time of CLOCK_MONOTONIC.
+// it is converted to the relative time because the absolute time of
+// EVFILT_TIMER is not portable.
+static inline int evm_ev_as_deadline(evm_ev_t *e, struct timespec deadline)
+{
+    struct timespec now;
+    lua_Integer nsec = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    nsec = evm_timespec2nsec(&deadline) - evm_timespec2nsec(&now);
+
+    return evm_ev_as_timer(e, (nsec > 0) ? nsec : 1, 1, 0, 0);
+}
+
+// re-arm the timer in place. re-adding the registered timer restarts it
+static inline int evm_ev_reset_timer(evm_ev_t *e, lua_Integer timeout)
+{
+    evm_t *s = e->s;
+
+    evm_timer_setdata(&e->reg, timeout);
+    if (!lauxh_isref(e->ref)) {
+        return 0;
+    } else if (kevent(s->fd, &e->reg, 1, NULL, 0, NULL) == -1) {
+        return -1;
+    }
+
+    // drop the expirations that are not delivered yet, otherwise the
+    // one-shot timer is released while it is registered again
+    for (int i = s->nevt - 1; i >= 0; i--) {
+        if (s->evs[i].filter == EVFILT_TIMER && s->evs[i].udata == e) {
+            s->nevt--;
+            memmove(s->evs + i, s->evs + i + 1,
+                    sizeof(kevt_t) * (size_t)(s->nevt - i));
+        }
+    }
+
+    return 0;
+}
+
+// MARK: export and import
+
+// get the attributes of the registered event to export.
+// returns 1 if exportable, 0 if not, or -1 on failure.
+static inline int evm_ev_export(evm_ev_t *e, evm_export_t *rec, int *fd)
+{
+    *rec = (evm_export_t){
+        .flags = ((e->reg.flags & EV_ONESHOT) ? EVM_EXPORT_ONESHOT : 0) |
+                 ((e->reg.flags & EV_CLEAR) ? EVM_EXPORT_EDGE : 0),
+    };
+    *fd  = -1;
+    // process-local resources
+    if (e->inbox || e->chan || e->loop) {
+        return 0;
+    }
+
+    switch (e->reg.filter) {
+    case EVFILT_READ:
+        if (e->dgram) {
+            rec->type    = EVM_EXPORT_DATAGRAM;
+            rec->nmsg    = (uint16_t)e->dgram->nmsg;
+            rec->pktsize = (uint32_t)e->dgram->pktsize;
+        } else {
+            rec->type = EVM_EXPORT_READABLE;
+        }
+        *fd = (int)e->reg.ident;
+        return 1;
+
+    case EVFILT_WRITE:
+        rec->type = EVM_EXPORT_WRITABLE;
+        *fd       = (int)e->reg.ident;
+        return 1;
+
+    case EVFILT_TIMER:
+        // kqueue does not report the remaining time of the timer
+        rec->type   = EVM_EXPORT_TIMER;
+        rec->ident  = (int64_t)evm_ev_timer_nsec(e);
+        rec->remain = rec->ident;
+        return 1;
+
+    case EVFILT_SIGNAL:
+        rec->type  = EVM_EXPORT_SIGNAL;
+        rec->ident = (int64_t)e->reg.ident;
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+// set the remaining time of the imported timer
+static inline int evm_ev_set_remain(evm_ev_t *e, lua_Integer remain)
+{
+    // timer of kqueue always starts with the full period
+    (void)e;
+    (void)remain;
+    return 0;
+}
+
 static inline int evm_ev_is_oneshot(evm_ev_t *e)
 {
     return e->reg.flags & EV_ONESHOT;
@@ -179,6 +627,107 @@ static inline int evm_ev_is_hup(evm_ev_t *e)
     return e->evt.flags & (EV_EOF | EV_ERROR);
 }
 
+// push the type-specific results of the occurred event
+static inline int evm_ev_pushresult(lua_State *L, evm_ev_t *e)
+{
+    if (e->reg.filter == EVFILT_JOB) {
+        return evm_job_pushresult(L, e->job);
+    } else if (e->inbox) {
+        return evm_inbox_pushresult(L, e);
+    } else if (e->chan) {
+        return evm_chan_pushresult(L, e);
+    } else if (e->loop) {
+        return evm_loop_pushresult(L, e);
+    } else if (e->dgram) {
+        // receive datagrams into the arena
+        if (evm_dgram_recv(e->dgram, (int)e->reg.ident) == -1) {
+            lua_pushinteger(L, 0);
+            lua_errno_new(L, errno, "recv");
+            return 2;
+        }
+        lua_pushinteger(L, e->dgram->nrecv);
+        return 1;
+    } else if (e->reg.filter == EVFILT_TIMER) {
+        // number of the expirations since the last delivery
+        lua_pushinteger(L, (lua_Integer)e->evt.data);
+        return 1;
+    } else if (e->reg.filter == EVFILT_PROC) {
+        return evm_proc_pushstatus(L, (int)e->evt.data);
+    } else if (e->reg.filter == EVFILT_VNODE) {
+        // name of the changed entry is not reported by kqueue
+        lua_pushinteger(L,
+                        evm_vnode_tomask(e->evt.fflags, (int)e->reg.data));
+        return 1;
+    }
+
+    return 0;
+}
+
+// push the readiness of the occurred event: mask, number of bytes available
+// to read or write, and error
+static inline int evm_ev_revents_lua(lua_State *L, const char *mt)
+{
+    evm_ev_t *e = luaL_checkudata(L, 1, mt);
+    kevt_t *evt = &e->evt;
+    int err     = 0;
+    int rev     = 0;
+
+    if (evt->flags & EV_ERROR) {
+        err = (int)evt->data;
+    } else if (evt->flags & EV_EOF) {
+        // socket error is set to fflags
+        err = (int)evt->fflags;
+    }
+    rev = ((evt->filter == EVFILT_READ) ? EVM_REV_READ : 0) |
+          ((evt->filter == EVFILT_WRITE) ? EVM_REV_WRITE : 0) |
+          ((evt->flags & EV_EOF) ? EVM_REV_HUP : 0) | (err ? EVM_REV_ERR : 0);
+
+    lua_pushinteger(L, rev);
+    if (rev & (EVM_REV_READ | EVM_REV_WRITE) && !(evt->flags & EV_ERROR)) {
+        lua_pushinteger(L, (lua_Integer)evt->data);
+    } else {
+        lua_pushnil(L);
+    }
+    if (err) {
+        lua_errno_new(L, err, "revents");
+        return 3;
+    }
+
+    return 2;
+}
+
+// set the low-water mark to signal the readiness.
+// 0 means the default of the system.
+static inline int evm_ev_set_lowat(evm_ev_t *e, int lowat)
+{
+    e->reg.fflags = lowat ? NOTE_LOWAT : 0;
+    e->reg.data   = lowat;
+    // modify the registered event
+    if (lauxh_isref(e->ref)) {
+        return kevent(e->s->fd, &e->reg, 1, NULL, 0, NULL);
+    }
+
+    return 0;
+}
+
+static inline int evm_ev_lowat_lua(lua_State *L, const char *mt)
+{
+    evm_ev_t *e       = luaL_checkudata(L, 1, mt);
+    lua_Integer lowat = lauxh_checkinteger(L, 2);
+
+    if (lowat < 0 || lowat > INT_MAX) {
+        return luaL_argerror(L, 2,
+                             "lowat value range must be 0 to " MSTRCAT(INT_MAX));
+    } else if (evm_ev_set_lowat(e, (int)lowat) == -1) {
+        lua_pushboolean(L, 0);
+        lua_errno_new(L, errno, "lowat");
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
 static inline int evm_ev_ident_lua(lua_State *L, const char *mt)
 {
     evm_ev_t *e = luaL_checkudata(L, 1, mt);
@@ -225,7 +774,7 @@ static inline int evm_ev_unwatch_lua(lua_State *L, const char *mt,
         // unregister event
         evt.flags = EV_DELETE;
         kevent(e->s->fd, &evt, 1, NULL, 0, NULL);
-        e->s->nreg--;
+        evm_ev_unlink(e);
         e->ref = lauxh_unref(L, e->ref);
         if (ev) {
             *ev = e;
@@ -237,4 +786,96 @@ static inline int evm_ev_unwatch_lua(lua_State *L, const char *mt,
     return 1;
 }
 
+// the event can be changed with the other events by a single changelist
+static inline int evm_ev_batchable(evm_ev_t *e)
+{
+    // internal descriptors
+    if (e->inbox || e->chan || e->loop) {
+        return 0;
+    }
+
+    switch (e->reg.filter) {
+    case EVFILT_READ:
+    case EVFILT_WRITE:
+    case EVFILT_TIMER:
+    case EVFILT_SIGNAL:
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+static inline void evm_ev_batch_fdset(evm_ev_t *e, int watch)
+{
+    switch (e->reg.filter) {
+    case EVFILT_READ:
+        if (watch) {
+            fdaddset(&e->s->fds, e->reg.ident, FDSET_READ);
+        } else {
+            fddelset(&e->s->fds, e->reg.ident, FDSET_READ);
+        }
+        break;
+    case EVFILT_WRITE:
+        if (watch) {
+            fdaddset(&e->s->fds, e->reg.ident, FDSET_WRITE);
+        } else {
+            fddelset(&e->s->fds, e->reg.ident, FDSET_WRITE);
+        }
+        break;
+    case EVFILT_SIGNAL:
+        if (watch) {
+            sigaddset(&e->s->signals, e->reg.ident);
+        } else {
+            sigdelset(&e->s->signals, e->reg.ident);
+        }
+        break;
+    }
+}
+
+// register or unregister the batchable events by a single changelist. the
+// events that failed to be registered are set to NULL, and unregistration does
+// not fail.
+static inline void evm_ev_batch(evm_t *s, evm_ev_t **evs, int n, int watch)
+{
+    kevt_t *chg = NULL;
+    int i       = 0;
+
+    if (!n) {
+        return;
+    } else if ((watch && evm_increase_evs(s, n) == -1) ||
+               !(chg = pnalloc((size_t)n, kevt_t))) {
+        // the events are retried one by one
+        for (i = 0; i < n; i++) {
+            evs[i] = NULL;
+        }
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        chg[i] = evs[i]->reg;
+        if (!watch) {
+            chg[i].flags = EV_DELETE;
+        }
+    }
+    evm_apply_changes(s, chg, n);
+
+    for (i = 0; i < n; i++) {
+        evm_ev_t *e = evs[i];
+
+        if (!watch) {
+            // unregistration result is ignored
+            evm_ev_unlink(e);
+            evm_ev_batch_fdset(e, 0);
+        } else if (!(chg[i].flags & EV_ERROR) || chg[i].data ||
+                   chg[i].udata != (void *)e) {
+            evs[i] = NULL;
+        } else {
+            evm_ev_link(e);
+            evm_ev_batch_fdset(e, 1);
+        }
+    }
+    pdealloc(chg);
+}
+
 #endif
@@ -27,6 +27,7 @@
 #ifndef evm_kevent_types_h
 #define evm_kevent_types_h
 
+#include <fcntl.h>
 #include <sys/event.h>
 
 // kernel event-loop fd creator
@@ -36,15 +37,49 @@
 typedef struct kevent kevt_t;
 
 typedef struct evm_st evm_t;
+typedef struct evm_dgram_st evm_dgram_t;
+typedef struct evm_job_st evm_job_t;
+typedef struct evm_inbox_st evm_inbox_t;
+typedef struct evm_chan_st evm_chan_t;
 
-typedef struct {
+typedef struct evm_ev_st {
     evm_t *s;
     kevt_t reg;
     kevt_t evt;
     int ref;
     int ctx;
+    evm_dgram_t *dgram;
+    char *path;
+    evm_job_t *job;
+    evm_inbox_t *inbox;
+    evm_chan_t *chan;
+    // child loop of the loop event, its reference, and the maximum number of
+    // the events to collect from it at once
+    evm_t *loop;
+    int loopref;
+    int loopmax;
+    // deadline of the readable or writable event in nanoseconds
+    lua_Integer deadline;
+    // index in the deadline heap of evm_t, or -1 if not set
+    int didx;
+    // dispatch priority
+    int prio;
+    // list of the registered events of evm_t
+    struct evm_ev_st *prev;
+    struct evm_ev_st *next;
 } evm_ev_t;
 
+// same source of the kernel events, and merge them
+#define evm_kevt_equal(a, b)                                                   \
+ ((a)->ident == (b)->ident && (a)->filter == (b)->filter &&                    \
+  (a)->udata == (b)->udata)
+#define evm_kevt_merge(dst, src) (*(dst) = *(src))
+
 #define evm_ev_filter(e) ((e)->reg.filter)
 
+// pseudo filter of the pool jobs
+#define EVFILT_JOB INT16_MIN
+
+#define evm_ev_fd(e) ((int)(e)->reg.ident)
+
 #endif
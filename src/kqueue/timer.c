@@ -42,6 +42,11 @@ static int context_lua(lua_State *L)
     return evm_ev_context_lua(L, EVM_TIMER_MT);
 }
 
+static int priority_lua(lua_State *L)
+{
+    return evm_ev_priority_lua(L, EVM_TIMER_MT);
+}
+
 static int asa_lua(lua_State *L)
 {
     return evm_asa_lua(L, EVM_TIMER_MT);
@@ -51,7 +56,7 @@ static int ident_lua(lua_State *L)
 {
     evm_ev_t *e = luaL_checkudata(L, 1, EVM_TIMER_MT);
 
-    lua_pushinteger(L, e->reg.data);
+    evm_pushmsec(L, evm_ev_timer_nsec(e));
 
     return 1;
 }
@@ -69,6 +74,28 @@ static int renew_lua(lua_State *L)
     return watch_lua(L);
 }
 
+static int reset_lua(lua_State *L)
+{
+    evm_ev_t *e         = luaL_checkudata(L, 1, EVM_TIMER_MT);
+    lua_Integer timeout = evm_ev_timer_nsec(e);
+
+    if (!lua_isnoneornil(L, 2)) {
+        timeout = evm_msec2nsec(lauxh_checknumber(L, 2));
+    }
+    if (timeout <= 0) {
+        return luaL_argerror(L, 2, "timeout must be greater than 0 msec");
+    } else if (evm_ev_reset_timer(e, timeout) == -1) {
+        // got error
+        lua_pushboolean(L, 0);
+        lua_errno_new(L, errno, "reset");
+        return 2;
+    }
+    lua_settop(L, 1);
+
+    // register again if it has been disabled
+    return watch_lua(L);
+}
+
 static int revert_lua(lua_State *L)
 {
     unwatch_lua(L);
@@ -89,14 +116,16 @@ LUALIB_API int luaopen_evm_timer(lua_State *L)
         {NULL,         NULL         }
     };
     struct luaL_Reg method[] = {
-        {"revert",  revert_lua },
-        {"renew",   renew_lua  },
-        {"ident",   ident_lua  },
-        {"asa",     asa_lua    },
-        {"context", context_lua},
-        {"watch",   watch_lua  },
-        {"unwatch", unwatch_lua},
-        {NULL,      NULL       }
+        {"revert",   revert_lua  },
+        {"renew",    renew_lua   },
+        {"reset",    reset_lua   },
+        {"ident",    ident_lua   },
+        {"asa",      asa_lua     },
+        {"context",  context_lua },
+        {"priority", priority_lua},
+        {"watch",    watch_lua   },
+        {"unwatch",  unwatch_lua },
+        {NULL,       NULL        }
     };
 
     evm_define_mt(L, EVM_TIMER_MT, mmethod, method);
@@ -58,11 +58,31 @@ static int context_lua(lua_State *L)
     return evm_ev_context_lua(L, EVM_WRITABLE_MT);
 }
 
+static int priority_lua(lua_State *L)
+{
+    return evm_ev_priority_lua(L, EVM_WRITABLE_MT);
+}
+
 static int asa_lua(lua_State *L)
 {
     return evm_asa_lua(L, EVM_WRITABLE_MT);
 }
 
+static int revents_lua(lua_State *L)
+{
+    return evm_ev_revents_lua(L, EVM_WRITABLE_MT);
+}
+
+static int deadline_lua(lua_State *L)
+{
+    return evm_ev_deadline_lua(L, EVM_WRITABLE_MT);
+}
+
+static int lowat_lua(lua_State *L)
+{
+    return evm_ev_lowat_lua(L, EVM_WRITABLE_MT);
+}
+
 static int ident_lua(lua_State *L)
 {
     return evm_ev_ident_lua(L, EVM_WRITABLE_MT);
@@ -101,14 +121,18 @@ LUALIB_API int luaopen_evm_writable(lua_State *L)
         {NULL,         NULL         }
     };
     struct luaL_Reg method[] = {
-        {"revert",  revert_lua },
-        {"renew",   renew_lua  },
-        {"ident",   ident_lua  },
-        {"asa",     asa_lua    },
-        {"context", context_lua},
-        {"watch",   watch_lua  },
-        {"unwatch", unwatch_lua},
-        {NULL,      NULL       }
+        {"revert",   revert_lua  },
+        {"renew",    renew_lua   },
+        {"ident",    ident_lua   },
+        {"revents",  revents_lua },
+        {"lowat",    lowat_lua   },
+        {"deadline", deadline_lua},
+        {"asa",      asa_lua     },
+        {"context",  context_lua },
+        {"priority", priority_lua},
+        {"watch",    watch_lua   },
+        {"unwatch",  unwatch_lua },
+        {NULL,       NULL        }
     };
 
     evm_define_mt(L, EVM_WRITABLE_MT, mmethod, method);
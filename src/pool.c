@@ -0,0 +1,300 @@
+/**
+ *  Copyright (C) 2026 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  pool.c
+ *  lua-evm
+ */
+
+#include "evm_event.h"
+
+static int gai2errno(int rc)
+{
+    switch (rc) {
+    case EAI_SYSTEM:
+        return errno;
+    case EAI_AGAIN:
+        return EAGAIN;
+    case EAI_MEMORY:
+        return ENOMEM;
+    case EAI_NONAME:
+    case EAI_SERVICE:
+        return ENOENT;
+    case EAI_FAMILY:
+        return EAFNOSUPPORT;
+    default:
+        return EINVAL;
+    }
+}
+
+static void job_run(evm_job_t *job)
+{
+    switch (job->op) {
+    case EVM_JOB_FILEREAD:
+        if (job->offset < 0) {
+            job->rc = read(job->fd, job->buf, job->len);
+        } else {
+            job->rc = pread(job->fd, job->buf, job->len, job->offset);
+        }
+        break;
+
+    case EVM_JOB_FILEWRITE:
+        if (job->offset < 0) {
+            job->rc = write(job->fd, job->buf, job->len);
+        } else {
+            job->rc = pwrite(job->fd, job->buf, job->len, job->offset);
+        }
+        break;
+
+    case EVM_JOB_FSYNC:
+        job->rc = fsync(job->fd);
+        break;
+
+    case EVM_JOB_GETADDRINFO: {
+        struct addrinfo hints = {
+            .ai_family   = AF_UNSPEC,
+            .ai_socktype = SOCK_STREAM,
+        };
+        int rc = getaddrinfo(job->host, job->service, &hints, &job->ai);
+
+        if (rc != 0) {
+            job->ai = NULL;
+            errno   = gai2errno(rc);
+            job->rc = -1;
+        }
+    } break;
+    }
+
+    if (job->rc == -1) {
+        job->err = errno;
+    }
+}
+
+static void pool_release(evm_pool_t *p)
+{
+    if (__atomic_sub_fetch(&p->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_cond_destroy(&p->cond);
+        pthread_mutex_destroy(&p->mutex);
+        pdealloc(p->threads);
+        pdealloc(p->queue);
+        pdealloc(p);
+    }
+}
+
+static void *worker(void *arg)
+{
+    evm_pool_t *p = (evm_pool_t *)arg;
+
+    pthread_mutex_lock(&p->mutex);
+    for (;;) {
+        evm_job_t *job = NULL;
+
+        while (!p->nqueue && !p->shutdown) {
+            pthread_cond_wait(&p->cond, &p->mutex);
+        }
+        // the queued jobs are cancelled by the shutdown
+        if (p->shutdown) {
+            break;
+        }
+
+        job       = p->queue[p->qhead];
+        p->qhead  = (p->qhead + 1) % p->qdepth;
+        p->nqueue--;
+        p->nrunning++;
+        pthread_mutex_unlock(&p->mutex);
+
+        job_run(job);
+        evm_cq_push(job->cq, job);
+
+        pthread_mutex_lock(&p->mutex);
+        p->nrunning--;
+        p->completed++;
+    }
+    pthread_mutex_unlock(&p->mutex);
+    pool_release(p);
+
+    return NULL;
+}
+
+int evm_pool_submit(evm_pool_t *p, evm_job_t *job)
+{
+    pthread_mutex_lock(&p->mutex);
+    // queue is full
+    if (p->nqueue == p->qdepth) {
+        p->saturated++;
+        pthread_mutex_unlock(&p->mutex);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    p->queue[(p->qhead + p->nqueue) % p->qdepth] = job;
+    p->nqueue++;
+    p->submitted++;
+    if (p->nqueue > p->peak) {
+        p->peak = p->nqueue;
+    }
+    pthread_cond_signal(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+
+    return 0;
+}
+
+// cancel the queued jobs and detach the worker threads without waiting for
+// the running jobs
+static void pool_shutdown(evm_pool_t *p)
+{
+    int i = 0;
+
+    pthread_mutex_lock(&p->mutex);
+    p->shutdown = 1;
+    for (; p->nqueue; p->nqueue--) {
+        evm_job_t *job = p->queue[p->qhead];
+
+        p->qhead = (p->qhead + 1) % p->qdepth;
+        job->rc  = -1;
+        job->err = ECANCELED;
+        evm_cq_push(job->cq, job);
+    }
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+
+    for (; i < p->nthreads; i++) {
+        pthread_detach(p->threads[i]);
+    }
+    pool_release(p);
+}
+
+static int stats_lua(lua_State *L)
+{
+    evm_pool_t *p = *(evm_pool_t **)luaL_checkudata(L, 1, EVM_POOL_MT);
+
+    pthread_mutex_lock(&p->mutex);
+    lua_createtable(L, 0, 8);
+    lauxh_pushint2tbl(L, "nthreads", p->nthreads);
+    lauxh_pushint2tbl(L, "qdepth", (lua_Integer)p->qdepth);
+    lauxh_pushint2tbl(L, "queued", (lua_Integer)p->nqueue);
+    lauxh_pushint2tbl(L, "running", (lua_Integer)p->nrunning);
+    lauxh_pushint2tbl(L, "peak", (lua_Integer)p->peak);
+    lauxh_pushint2tbl(L, "submitted", (lua_Integer)p->submitted);
+    lauxh_pushint2tbl(L, "completed", (lua_Integer)p->completed);
+    // number of jobs rejected because the queue was full
+    lauxh_pushint2tbl(L, "saturated", (lua_Integer)p->saturated);
+    pthread_mutex_unlock(&p->mutex);
+
+    return 1;
+}
+
+static int gc_lua(lua_State *L)
+{
+    evm_pool_t **p = lua_touserdata(L, 1);
+
+    if (*p) {
+        pool_shutdown(*p);
+        *p = NULL;
+    }
+
+    return 0;
+}
+
+static int tostring_lua(lua_State *L)
+{
+    return TOSTRING_MT(L, EVM_POOL_MT);
+}
+
+int evm_pool_new_lua(lua_State *L)
+{
+    lua_Integer nthreads = lauxh_optinteger(L, 1, EVM_POOL_NTHREADS);
+    lua_Integer qdepth   = lauxh_optinteger(L, 2, EVM_POOL_QDEPTH);
+    evm_pool_t **pp      = NULL;
+    evm_pool_t *p        = NULL;
+    sigset_t all, old;
+    int rc = 0;
+
+    // check arguments
+    if (nthreads < 1 || nthreads > EVM_POOL_MAXTHREADS) {
+        return lauxh_argerror(L, 1, "nthreads value range must be 1 to %d",
+                              EVM_POOL_MAXTHREADS);
+    } else if (qdepth < 1 || qdepth > INT_MAX) {
+        return lauxh_argerror(L, 2, "qdepth value range must be 1 to %d",
+                              INT_MAX);
+    }
+
+    pp = lua_newuserdata(L, sizeof(evm_pool_t *));
+    if (!(p = pcalloc(evm_pool_t)) ||
+        !(p->threads = pcnalloc((size_t)nthreads, pthread_t)) ||
+        !(p->queue = pcnalloc((size_t)qdepth, evm_job_t *))) {
+        if (p) {
+            pdealloc(p->threads);
+            pdealloc(p);
+        }
+        lua_pushnil(L);
+        lua_errno_new(L, errno, "pool");
+        return 2;
+    }
+    // released by the pool object
+    p->refcnt = 1;
+    p->qdepth = (size_t)qdepth;
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    *pp = p;
+    lauxh_setmetatable(L, EVM_POOL_MT);
+
+    // block all signals in worker threads to keep signals delivered to the
+    // event loop thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (; p->nthreads < nthreads; p->nthreads++) {
+        // released by the worker thread
+        p->refcnt++;
+        if ((rc = pthread_create(&p->threads[p->nthreads], NULL, worker, p))) {
+            p->refcnt--;
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (rc) {
+        // stop the created threads
+        pool_shutdown(p);
+        *pp = NULL;
+        lua_pushnil(L);
+        lua_errno_new(L, rc, "pool");
+        return 2;
+    }
+
+    return 1;
+}
+
+LUALIB_API int luaopen_evm_pool(lua_State *L)
+{
+    struct luaL_Reg mmethod[] = {
+        {"__gc",       gc_lua      },
+        {"__tostring", tostring_lua},
+        {NULL,         NULL        }
+    };
+    struct luaL_Reg method[] = {
+        {"stats", stats_lua},
+        {NULL,    NULL     }
+    };
+
+    evm_define_mt(L, EVM_POOL_MT, mmethod, method);
+
+    return 0;
+}
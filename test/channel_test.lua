@@ -0,0 +1,117 @@
+local testcase = require('testcase')
+local evm = require('evm')
+local fork = require('fork')
+
+function testcase.channel()
+    local m = assert(evm.new())
+    local ch = assert(evm.channel(64))
+    assert.match(ch, '^evm.channel: ', false)
+
+    -- test that event use as a message event
+    local ev = m:newevent()
+    assert(ev:asmessage(ch, 'ctx'))
+    assert.match(ev, '^evm.message: ', false)
+    assert.equal(ev:asa(), 'asmessage')
+
+    -- test that messages are delivered in a batch
+    assert.equal(ch:send('foo', 'bar'), 2)
+    assert.equal(ch:send('baz'), 1)
+    assert.equal(m:wait(1000), 1)
+    local rev, ctx, disabled, msgs, closed = m:getevent()
+    assert.equal(rev, ev)
+    assert.equal(ctx, 'ctx')
+    assert.is_false(disabled)
+    assert.equal(msgs, {
+        'foo',
+        'bar',
+        'baz',
+    })
+    assert.is_false(closed)
+
+    -- test that doorbell is rung only when the channel becomes non-empty
+    local stats = ch:stats()
+    assert.equal(stats.sent, 3)
+    assert.equal(stats.rung, 1)
+    assert.equal(stats.received, 3)
+    assert.equal(stats.queued, 0)
+
+    -- test that returns EAGAIN if the channel is full
+    local msg = string.rep('x', 28)
+    assert.equal(ch:send(msg, msg, msg), 2)
+    local n, err = ch:send(msg)
+    assert.is_nil(n)
+    assert.match(err, 'EAGAIN')
+    assert.equal(m:wait(1000), 1)
+    rev, _, _, msgs = m:getevent()
+    assert.equal(msgs, {
+        msg,
+        msg,
+    })
+
+    -- test that message wrapped around the end of the ring is received
+    assert.equal(ch:send(string.rep('y', 40)), 1)
+    assert.equal(m:wait(1000), 1)
+    rev, _, _, msgs = m:getevent()
+    assert.equal(msgs, {
+        string.rep('y', 40),
+    })
+
+    -- test that returns EMSGSIZE if the message is too large
+    n, err = ch:send(string.rep('x', 61))
+    assert.is_nil(n)
+    assert.match(err, 'EMSGSIZE')
+
+    -- test that consumer is notified when the channel is closed
+    ch:close()
+    assert.equal(m:wait(1000), 1)
+    rev, _, _, msgs, closed = m:getevent()
+    assert.equal(msgs, {})
+    assert.is_true(closed)
+    n, err = ch:send('foo')
+    assert.is_nil(n)
+    assert.match(err, 'EPIPE')
+end
+
+function testcase.channel_fork()
+    local m = assert(evm.new())
+    local ch = assert(evm.channel())
+    assert(m:newevent():asmessage(ch))
+
+    -- test that messages are sent from the forked process
+    local p = assert(fork())
+    if p:is_child() then
+        for i = 1, 100 do
+            while not ch:send(tostring(i)) do
+            end
+        end
+        ch:close()
+        os.exit(0)
+    end
+
+    local list = {}
+    local closed
+    repeat
+        assert(m:wait(1000))
+        local ev, _, _, msgs, eof = m:getevent()
+        while ev do
+            for _, msg in ipairs(msgs) do
+                list[#list + 1] = tonumber(msg)
+            end
+            closed = eof
+            ev, _, _, msgs, eof = m:getevent()
+        end
+    until closed
+    assert.equal(#list, 100)
+    for i = 1, 100 do
+        assert.equal(list[i], i)
+    end
+end
+
+function testcase.channel_invalid_arguments()
+    -- test that throws an error if arguments are invalid
+    local err = assert.throws(evm.channel, 1)
+    assert.match(err, 'size value range')
+    local ch = assert(evm.channel())
+    err = assert.throws(ch.send, ch)
+    assert.match(err, 'string expected')
+end
@@ -0,0 +1,74 @@
+local testcase = require('testcase')
+local evm = require('evm')
+
+function testcase.cluster()
+    local marker = os.tmpname()
+    os.remove(marker)
+
+    -- test that fork workers with their own listener
+    local c = assert(evm.cluster({
+        workers = 2,
+        host = '127.0.0.1',
+        port = 0,
+    }, function(m, fd, idx, report)
+        assert(type(fd) == 'number')
+        assert(m:newevent():asreadable(fd))
+        assert(report())
+        -- crash the first worker only once
+        if idx == 1 and not io.open(marker) then
+            assert(io.open(marker, 'w')):close()
+            os.exit(1)
+        end
+    end))
+    assert.match(c, '^evm.cluster: ', false)
+    assert.greater(c:port(), 0)
+
+    -- test that crashed worker is restarted
+    local n
+    repeat
+        n = assert(c:wait(1000))
+    until n == 0
+    local stats = c:stats()
+    assert.equal(#stats, 2)
+    assert.equal(stats[1].restarts, 1)
+    assert.equal(stats[2].restarts, 0)
+    -- test that loop stats are reported by the workers
+    assert.equal(stats[1].nreg, 1)
+    assert.equal(stats[2].nreg, 1)
+    os.remove(marker)
+end
+
+function testcase.shutdown()
+    -- test that workers are not restarted after shutdown
+    local c = assert(evm.cluster({
+        workers = 2,
+        host = '127.0.0.1',
+        port = 0,
+    }, function(m, fd)
+        assert(m:newevent():asreadable(fd))
+        while true do
+            m:wait()
+        end
+    end))
+    c:shutdown()
+    local n
+    repeat
+        n = assert(c:wait(1000))
+    until n == 0
+    for _, v in ipairs(c:stats()) do
+        assert.equal(v.restarts, 0)
+    end
+end
+
+function testcase.invalid_arguments()
+    -- test that throws an error if arguments are invalid
+    local err = assert.throws(evm.cluster, {
+        workers = 0,
+        port = 0,
+    }, function()
+    end)
+    assert.match(err, 'workers must be greater than 0')
+    err = assert.throws(evm.cluster, {}, function()
+    end)
+    assert.match(err, 'port must be a string or an integer')
+end
@@ -0,0 +1,118 @@
+local testcase = require('testcase')
+local llsocket = require('llsocket')
+local evm = require('evm')
+
+-- socketpair
+local SOCK1
+local SOCK2
+
+function testcase.before_all()
+    local pair = assert(llsocket.socket.pair(llsocket.SOCK_DGRAM))
+    SOCK1, SOCK2 = pair[1], pair[2]
+end
+
+function testcase.asdatagram()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+    local ctx = {
+        'foo/bar',
+    }
+
+    -- test that event use as a datagram event
+    assert(ev:asdatagram(SOCK1:fd(), 4, ctx))
+    assert.match(ev, '^evm.datagram: ', false)
+    assert.equal(ev:ident(), SOCK1:fd())
+    assert.equal(ev:asa(), 'asdatagram')
+    assert.equal(ev:context(), ctx)
+    assert.equal(#ev, 0)
+
+    -- test that no event occurs if no datagram arrives
+    local n, err = m:wait(5)
+    assert.equal(n, 0)
+    assert.is_nil(err)
+    assert.is_nil(m:getevent())
+
+    -- test that datagrams are received in a batch
+    for i = 1, 6 do
+        assert(SOCK2:send('msg' .. i))
+    end
+    n, err = m:wait(5)
+    assert.equal(n, 1)
+    assert.is_nil(err)
+    local rev, rctx, disabled, nrecv, rerr = m:getevent()
+    assert.equal(rev, ev)
+    assert.equal(rctx, ctx)
+    assert.is_false(disabled)
+    assert.equal(nrecv, 4)
+    assert.is_nil(rerr)
+    assert.equal(#ev, 4)
+    for i = 1, 4 do
+        assert.equal(ev:packet(i), 'msg' .. i)
+    end
+    assert.is_nil(ev:packet(5))
+
+    -- test that remaining datagrams can be received by recv method
+    assert.equal(ev:recv(), 2)
+    assert.equal(ev:packet(1), 'msg5')
+    assert.equal(ev:packet(2), 'msg6')
+    assert.equal(ev:recv(), 0)
+    assert.equal(#ev, 0)
+
+    -- test that throws an error if batch or pktsize is out of range
+    ev = ev:revert()
+    err = assert.throws(ev.asdatagram, ev, SOCK1:fd(), 0)
+    assert.match(err, 'batch value range')
+    err = assert.throws(ev.asdatagram, ev, SOCK1:fd(), 1, nil, nil, nil, 0)
+    assert.match(err, 'pktsize value range')
+end
+
+function testcase.asdatagram_pktsize()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+    assert(ev:asdatagram(SOCK1:fd(), 4, nil, nil, nil, 8))
+
+    -- test that datagrams larger than pktsize are dropped
+    assert(SOCK2:send('small'))
+    assert(SOCK2:send('larger than pktsize'))
+    assert(SOCK2:send('fits'))
+    assert.equal(m:wait(5), 1)
+    assert.equal(select(4, m:getevent()), 2)
+    assert.equal(ev:packet(1), 'small')
+    assert.equal(ev:packet(2), 'fits')
+
+    -- test that sendto returns an error if msg is larger than pktsize
+    local ok, err = ev:sendto('larger than pktsize')
+    assert.is_false(ok)
+    assert.match(err, 'EMSGSIZE')
+    assert(ev:sendto('fits'))
+    assert.equal(ev:flush(), 1)
+    assert.equal(SOCK2:recv(), 'fits')
+
+    ev:revert()
+end
+
+function testcase.sendto_flush()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+    assert(ev:asdatagram(SOCK1:fd(), 2))
+
+    -- test that datagrams are queued until flushed
+    assert(ev:sendto('hello'))
+    assert(ev:sendto('world'))
+    -- test that full queue is flushed automatically
+    assert(ev:sendto('!'))
+    assert.equal(SOCK2:recv(), 'hello')
+    assert.equal(SOCK2:recv(), 'world')
+
+    -- test that flush sends the queued datagrams
+    assert.equal(ev:flush(), 1)
+    assert.equal(SOCK2:recv(), '!')
+    assert.equal(ev:flush(), 0)
+
+    -- test that return an error if address is invalid
+    local ok, err = ev:sendto('hello', 'invalid-address', 8080)
+    assert.is_false(ok)
+    assert.match(err, 'sendto')
+
+    ev:revert()
+end
@@ -1,6 +1,7 @@
 local testcase = require('testcase')
 local llsocket = require('llsocket')
 local evm = require('evm')
+local fork = require('fork')
 
 -- socketpair
 local SOCK1
@@ -73,6 +74,58 @@ function testcase.renew()
     assert.equal(SOCK1:read(), 'hello')
 end
 
+function testcase.renew_reregister()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+    assert(ev:asreadable(SOCK1:fd()))
+    local tev = m:newevent()
+    assert(tev:astimer(10, nil, true))
+    assert(SOCK2:send('hello'))
+
+    -- test that all registered events are registered to the renewed one
+    assert(m:renew({
+        reregister = true,
+    }))
+    assert.equal(#m, 2)
+    local occurred = {}
+    while not occurred[tev] do
+        assert(m:wait(1000))
+        local rev = m:getevent()
+        while rev do
+            occurred[rev] = true
+            rev = m:getevent()
+        end
+    end
+    assert.is_true(occurred[ev])
+    assert.equal(SOCK1:read(), 'hello')
+
+    -- test that throws an error if options is invalid
+    local err = assert.throws(m.renew, m, true)
+    assert.match(err, 'table expected')
+end
+
+function testcase.default_after_fork()
+    local m = assert(evm.default())
+    local ev = m:newevent()
+    assert(ev:asreadable(SOCK1:fd()))
+
+    -- test that default evm inherits the registered events after fork
+    local p = assert(fork())
+    if p:is_child() then
+        local ok = evm.default() == m and #m == 1 and m:wait(1000) == 1 and
+                       m:getevent() == ev
+        os.exit(ok and 0 or 1)
+    end
+    assert(SOCK2:send('hello'))
+    local pm = assert(evm.new())
+    assert(pm:newevent():asproc(p:pid()))
+    assert.equal(pm:wait(2000), 1)
+    local _, _, _, code = pm:getevent()
+    assert.equal(code, 0)
+    assert.equal(SOCK1:read(), 'hello')
+    ev:revert()
+end
+
 function testcase.wait()
     local m = assert(evm.new())
 
@@ -101,3 +154,514 @@ function testcase.wait()
     ev:revert()
 end
 
+function testcase.now()
+    local m = assert(evm.new())
+    local now = m:now()
+    assert.is_number(now)
+    assert.is_number(m:now_realtime())
+
+    -- test that cached time is not changed until wait returns
+    local ev = m:newevent()
+    assert(ev:astimer(50, nil, true))
+    assert.equal(m:now(), now)
+
+    -- test that cached time is updated after wait
+    assert.equal(m:wait(), 1)
+    assert.greater_or_equal(m:now() - now, 0.04)
+    ev:revert()
+
+    -- test that update_now updates the cached time
+    now = m:now()
+    local updated = m:update_now()
+    assert.greater_or_equal(updated, now)
+    assert.equal(m:now(), updated)
+
+    -- test that coarse clock can be selected
+    m = assert(evm.new(nil, {
+        coarse = true,
+    }))
+    assert.is_number(m:now())
+
+    -- test that throws an error if opts is not table
+    local err = assert.throws(evm.new, nil, 'foo')
+    assert.match(err, 'table expected')
+end
+
+function testcase.busypoll()
+    local m = assert(evm.new(nil, {
+        busypoll = 200,
+    }))
+    assert.equal(m:busypoll(), 200)
+
+    -- test that events are found by the busy-poll
+    local ev = m:newevent()
+    assert(ev:asreadable(SOCK1:fd()))
+    assert(SOCK2:send('hello'))
+    assert.equal(m:wait(100), 1)
+    assert.equal(m:getevent(), ev)
+    assert.equal(SOCK1:read(), 'hello')
+    local stats = m:stats()
+    assert.greater(stats.nspin, 0)
+    assert.equal(stats.nspin_event, 1)
+
+    -- test that wait blocks after the budget is spent
+    assert.equal(m:wait(10), 0)
+    stats = m:stats()
+    assert.greater(stats.nspin, 1)
+    assert.greater_or_equal(stats.spin_usec, 0)
+    ev:revert()
+
+    -- test that busy-poll can be disabled
+    assert.equal(m:busypoll(0), 0)
+    local nspin = m:stats().nspin
+    ev = m:newevent()
+    assert(ev:asreadable(SOCK1:fd()))
+    assert.equal(m:wait(5), 0)
+    assert.equal(m:stats().nspin, nspin)
+    ev:revert()
+
+    -- test that throws an error if usec is invalid
+    local err = assert.throws(m.busypoll, m, -1)
+    assert.match(err, 'usec value range')
+end
+
+function testcase.wait_min_events()
+    local m = assert(evm.new())
+    local pair = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+    local ev1 = m:newevent()
+    local ev2 = m:newevent()
+    assert(ev1:asreadable(SOCK1:fd()))
+    assert(ev2:asreadable(pair[1]:fd()))
+
+    -- test that wait returns when min_events are collected
+    assert(SOCK2:send('hello'))
+    local p = assert(fork())
+    if p:is_child() then
+        os.execute('sleep 0.01')
+        pair[2]:send('world')
+        os.exit(0)
+    end
+    local n, err = m:wait(100, {
+        min_events = 2,
+        max_delay_us = 500000,
+    })
+    assert.equal(n, 2)
+    assert.is_nil(err)
+    local evs = {}
+    for _ = 1, 2 do
+        evs[assert(m:getevent())] = true
+    end
+    assert.is_nil(m:getevent())
+    assert.equal(evs, {
+        [ev1] = true,
+        [ev2] = true,
+    })
+    assert.greater(m:stats().nbatch, 0)
+
+    -- test that wait returns after max_delay_us even if fewer events
+    assert.equal(pair[1]:read(), 'world')
+    n = m:wait(100, {
+        min_events = 2,
+        max_delay_us = 5000,
+    })
+    assert.equal(n, 1)
+    assert.equal(m:getevent(), ev1)
+    assert.is_nil(m:getevent())
+    assert.equal(SOCK1:read(), 'hello')
+
+    -- test that throws an error if opts is invalid
+    err = assert.throws(m.wait, m, 1, {
+        min_events = 0,
+    })
+    assert.match(err, 'opts.min_events')
+    err = assert.throws(m.wait, m, 1, {
+        max_delay_us = -1,
+    })
+    assert.match(err, 'opts.max_delay_us')
+
+    ev1:revert()
+    ev2:revert()
+    pair[1]:close()
+    pair[2]:close()
+end
+
+function testcase.priority()
+    local m = assert(evm.new())
+    local evs = {}
+    local socks = {}
+    for i = 1, 3 do
+        socks[i] = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+        evs[i] = m:newevent()
+        assert(evs[i]:asreadable(socks[i][1]:fd()))
+        assert(socks[i][2]:send('hello'))
+    end
+
+    -- test that priority is 0 by default
+    assert.equal(evs[1]:priority(), 0)
+
+    -- test that events are delivered in descending order of priority
+    assert.equal(evs[2]:priority(7), 7)
+    assert.equal(evs[3]:priority(3), 3)
+    assert.equal(m:wait(10), 3)
+    assert.equal(m:getevent(), evs[2])
+    assert.equal(m:getevent(), evs[3])
+    assert.equal(m:getevent(), evs[1])
+    assert.is_nil(m:getevent())
+
+    -- test that events of the same priority are rotated for each wait
+    evs[2]:priority(0)
+    evs[3]:priority(0)
+    local firsts = {}
+    for _ = 1, 3 do
+        assert.equal(m:wait(10), 3)
+        firsts[m:getevent()] = true
+    end
+    local n = 0
+    for _ in next, firsts do
+        n = n + 1
+    end
+    assert.equal(n, 3)
+
+    -- test that throws an error if priority is invalid
+    local err = assert.throws(evs[1].priority, evs[1], 8)
+    assert.match(err, 'priority value range')
+
+    for i = 1, 3 do
+        evs[i]:revert()
+        socks[i][1]:close()
+        socks[i][2]:close()
+    end
+end
+
+function testcase.budget()
+    local m = assert(evm.new())
+    local evs = {}
+    local socks = {}
+    for i = 1, 3 do
+        socks[i] = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+        evs[i] = m:newevent()
+        assert(evs[i]:asreadable(socks[i][1]:fd(), nil, true))
+        assert(socks[i][2]:send('hello'))
+    end
+    assert.equal({
+        m:budget(),
+    }, {
+        0,
+        0,
+    })
+
+    -- test that getevent returns nil if the budget is exhausted
+    assert.equal({
+        m:budget(2),
+    }, {
+        2,
+        0,
+    })
+    assert.equal(m:wait(10), 3)
+    local delivered = {}
+    for _ = 1, 2 do
+        delivered[assert(m:getevent())] = true
+    end
+    assert.is_nil(m:getevent())
+
+    -- test that the rest of events are delivered first, and then the due
+    -- timers and the expired deadlines before the other new events
+    local timer = m:newevent()
+    assert(timer:astimer(1, nil, true))
+    local pair = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+    local rev = m:newevent()
+    assert(rev:asreadable(pair[1]:fd(), nil, true))
+    local dev = m:newevent()
+    assert(dev:asreadable(pair[2]:fd(), nil, true, nil, nil, 1))
+    os.execute('sleep 0.005')
+    assert(pair[2]:send('hello'))
+    m:budget(10)
+    assert.equal(m:wait(), 4)
+    local ev = assert(m:getevent())
+    assert.is_nil(delivered[ev])
+    assert.equal(m:getevent(), timer)
+    local tev, _, _, timedout = m:getevent()
+    assert.equal(tev, dev)
+    assert.is_true(timedout)
+    assert.equal(m:getevent(), rev)
+    assert.is_nil(m:getevent())
+    assert.equal(m:stats().ncarried, 1)
+    dev:revert()
+    pair[1]:close()
+    pair[2]:close()
+
+    -- test that throws an error if budget is invalid
+    local err = assert.throws(m.budget, m, -1)
+    assert.match(err, 'nevent value range')
+    err = assert.throws(m.budget, m, 0, -1)
+    assert.match(err, 'usec value range')
+
+    for i = 1, 3 do
+        evs[i]:revert()
+        socks[i][1]:close()
+        socks[i][2]:close()
+    end
+end
+
+function testcase.post()
+    local m = assert(evm.new())
+    local fn = function()
+    end
+    local ev = m:newevent()
+
+    -- test that posted objects are returned in order without blocking
+    assert(m:post(fn, 'foo'))
+    assert(m:post(ev))
+    assert.equal(m:wait(), 2)
+    assert.equal({
+        m:getevent(),
+    }, {
+        fn,
+        'foo',
+    })
+    assert.equal({
+        m:getevent(),
+    }, {
+        ev,
+    })
+
+    -- test that objects posted while dispatching are returned in next wait
+    assert(m:post(fn))
+    assert.equal(m:wait(), 1)
+    assert(m:post(fn, 'bar'))
+    assert.equal(m:getevent(), fn)
+    assert.is_nil(m:getevent())
+    assert.equal({
+        m:wait(),
+        m:getevent(),
+    }, {
+        1,
+        fn,
+        'bar',
+    })
+    assert.equal(m:stats().nposted, 3)
+
+    -- test that throws an error if object is invalid
+    local err = assert.throws(m.post, m, 'foo')
+    assert.match(err, 'function or event object expected')
+end
+
+function testcase.hook()
+    local m = assert(evm.new())
+    local calls = {}
+    local ids = {}
+    for _, kind in ipairs({
+        'prepare',
+        'check',
+        'idle',
+    }) do
+        ids[kind] = assert(m:hook(kind, function(ctx)
+            calls[#calls + 1] = kind .. ':' .. ctx
+        end, kind))
+    end
+    local timer = m:newevent()
+    assert(timer:astimer(10, nil, true))
+
+    -- test that prepare, check and idle hooks are called if no events occurred
+    assert.equal(m:wait(0), 0)
+    assert.equal(calls, {
+        'prepare:prepare',
+        'check:check',
+        'idle:idle',
+    })
+
+    -- test that idle hooks are not called if events occurred
+    calls = {}
+    assert.equal(m:wait(), 1)
+    assert.equal(m:getevent(), timer)
+    assert.equal(calls, {
+        'prepare:prepare',
+        'check:check',
+    })
+
+    -- test that objects posted by prepare hook are returned without blocking
+    local fn = function()
+    end
+    local id = assert(m:hook('prepare', function()
+        m:post(fn)
+    end))
+    calls = {}
+    assert.equal(m:wait(), 1)
+    assert.equal(m:getevent(), fn)
+    assert.equal(calls, {
+        'prepare:prepare',
+        'check:check',
+    })
+
+    -- test that hook can be removed by hook
+    assert.is_true(m:unhook(id))
+    assert.is_false(m:unhook(id))
+    assert(m:hook('check', function()
+        calls[#calls + 1] = 'unhook'
+        m:unhook(ids.check)
+    end))
+    calls = {}
+    assert.equal(m:wait(0), 0)
+    assert.equal(calls, {
+        'prepare:prepare',
+        'check:check',
+        'unhook',
+        'idle:idle',
+    })
+    calls = {}
+    assert.equal(m:wait(0), 0)
+    assert.equal(calls, {
+        'prepare:prepare',
+        'unhook',
+        'idle:idle',
+    })
+
+    -- test that error of hook is rethrown
+    assert(m:hook('idle', function()
+        error('hook error')
+    end))
+    local err = assert.throws(m.wait, m, 0)
+    assert.match(err, 'hook error')
+
+    -- test that throws an error if kind is invalid
+    err = assert.throws(m.hook, m, 'foo', fn)
+    assert.match(err, 'invalid option')
+end
+
+function testcase.idlegc()
+    local m = assert(evm.new())
+    local pause = collectgarbage('setpause', 200)
+    collectgarbage('setpause', pause)
+    assert.equal({
+        m:idlegc(),
+    }, {
+        0,
+        1000,
+        false,
+    })
+
+    -- test that gc steps are run before blocking
+    assert.equal({
+        m:idlegc(64, 2000, true),
+    }, {
+        64,
+        2000,
+        true,
+    })
+    local timer = m:newevent()
+    assert(timer:astimer(10, nil, true))
+    for _ = 1, 1000 do
+        local _ = {}
+    end
+    assert.equal(m:wait(), 1)
+    assert.equal(m:getevent(), timer)
+    local stats = m:stats()
+    assert.equal(stats.ngcidle, 1)
+    assert.greater_or_equal(stats.gcidle_usec, 0)
+    assert.equal(stats.ngcslow, 1)
+
+    -- test that collector is slowed down while dispatching
+    assert.is_true(collectgarbage('isrunning'))
+    assert.equal(collectgarbage('setpause', 1000), 1000)
+    assert.equal(m:wait(0), 0)
+    assert.equal(collectgarbage('setpause', pause), pause)
+
+    -- test that gc steps are skipped if timeout is not enough
+    assert(timer:astimer(10, nil, true))
+    assert.equal(m:wait(1), 0)
+    assert.equal(m:stats().ngcidle, 1)
+    timer:revert()
+
+    -- test that throws an error if arguments are invalid
+    local err = assert.throws(m.idlegc, m, -1)
+    assert.match(err, 'kb value range')
+    err = assert.throws(m.idlegc, m, 1, 0)
+    assert.match(err, 'usec value range')
+end
+
+function testcase.group()
+    local m = assert(evm.new())
+    local g = m:group()
+    assert.match(g, '^evm.evgroup: ', false)
+    local pair = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+    local evs = m:newevents(3)
+    assert(evs[1]:asreadable(pair[1]:fd()))
+    assert(evs[2]:aswritable(pair[1]:fd()))
+    assert(evs[3]:astimer(1))
+
+    -- test that add event objects to group
+    assert(g:add(evs[1], evs[2], evs[3]))
+    assert.equal(#g, 3)
+    assert.equal(#m, 3)
+
+    -- test that pause unwatches all members
+    assert(g:pause())
+    assert.equal(#m, 0)
+    assert.equal(m:wait(5), 0)
+
+    -- test that resume watches all members again
+    assert(g:resume())
+    assert.equal(#m, 3)
+    assert.greater(m:wait(5), 0)
+
+    -- test that reverted event is removed from group
+    evs[3]:revert()
+    assert(g:pause())
+    assert.equal(#g, 2)
+
+    -- test that close reverts the members that watch the descriptor
+    assert(g:close(pair[1]:unwrap()))
+    pair[2]:close()
+    assert(g:resume())
+    assert.equal(#g, 0)
+    assert.equal(#m, 0)
+    assert.match(evs[1], '^evm.event: ', false)
+    assert.match(evs[2], '^evm.event: ', false)
+
+    -- test that members unregistered by the hangup are dropped, even if the
+    -- descriptor number is reused
+    pair = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+    local fd = pair[1]:fd()
+    assert(evs[1]:asreadable(fd))
+    assert(g:add(evs[1]))
+    pair[2]:close()
+    assert.equal(m:wait(5), 1)
+    assert.equal(m:getevent(), evs[1])
+    pair[1]:close()
+    pair = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+    assert.equal(pair[1]:fd(), fd)
+    assert(g:resume())
+    assert.equal(#g, 0)
+    assert.equal(#m, 0)
+    assert.match(evs[1], '^evm.event: ', false)
+    assert(pair[2]:send('hello'))
+    assert.equal(m:wait(5), 0)
+    pair[1]:close()
+    pair[2]:close()
+
+    -- test that revert reverts all members
+    pair = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+    assert(evs[1]:asreadable(pair[1]:fd()))
+    assert(evs[2]:aswritable(pair[1]:fd()))
+    assert(g:add(evs[1], evs[2]))
+    assert.is_true(g:remove(evs[2]))
+    assert.is_false(g:remove(evs[2]))
+    g:revert()
+    assert.equal(#g, 0)
+    assert.equal(#m, 1)
+    assert.match(evs[1], '^evm.event: ', false)
+    assert.match(evs[2], '^evm.writable: ', false)
+    evs[2]:revert()
+    pair[1]:close()
+    pair[2]:close()
+
+    -- test that throws an error if event object is invalid
+    local err = assert.throws(g.add, g, {})
+    assert.match(err, 'event object expected')
+    local m2 = assert(evm.new())
+    local ev = m2:newevent()
+    assert(ev:astimer(10))
+    err = assert.throws(g.add, g, ev)
+    assert.match(err, 'other event monitor')
+    ev:revert()
+end
@@ -0,0 +1,74 @@
+local testcase = require('testcase')
+local llsocket = require('llsocket')
+local evm = require('evm')
+
+local function export_import(socktype)
+    local m = assert(evm.new())
+    local pair = assert(llsocket.socket.pair(socktype))
+    local conn = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+
+    -- test that export the registered events
+    assert(m:newevent():asreadable(conn[1]:fd(), nil, false, true))
+    assert(m:newevent():astimer(50, nil, true))
+    -- process-local events are not exported
+    assert(m:newevent():asmessage(evm.channel()))
+    assert.equal(#m, 3)
+    assert.equal(assert(m:export(pair[1]:fd())), 2)
+
+    -- test that import the exported events into the new evm
+    local m2, evs = assert(evm.import(pair[2]:fd()))
+    assert.match(m2, '^evm: ', false)
+    assert.equal(#m2, 2)
+    assert.equal(#evs, 2)
+    local evmap = {}
+    for _, ev in ipairs(evs) do
+        evmap[ev:asa()] = ev
+    end
+    assert.match(evmap.asreadable, '^evm.readable: ', false)
+    assert.match(evmap.astimer, '^evm.timer: ', false)
+    -- imported descriptor refers to the same connection
+    assert.not_equal(evmap.asreadable:ident(), conn[1]:fd())
+
+    -- test that imported events occur
+    assert(conn[2]:send('hello'))
+    local occurred = {}
+    while not occurred.astimer do
+        assert(m2:wait(1000))
+        local ev, _, disabled = m2:getevent()
+        while ev do
+            occurred[ev:asa()] = disabled
+            ev, _, disabled = m2:getevent()
+        end
+    end
+    assert.is_false(occurred.asreadable)
+    -- oneshot flag is preserved
+    assert.is_true(occurred.astimer)
+end
+
+function testcase.export_import_stream()
+    export_import(llsocket.SOCK_STREAM)
+end
+
+function testcase.export_import_dgram()
+    export_import(llsocket.SOCK_DGRAM)
+end
+
+function testcase.import_invalid_message()
+    local pair = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+
+    -- test that returns EPROTO if the message is not an export message
+    assert(pair[1]:send('invalid export message'))
+    local m, err = evm.import(pair[2]:fd())
+    assert.is_nil(m)
+    assert.match(err, 'EPROTO')
+end
+
+function testcase.invalid_arguments()
+    local m = assert(evm.new())
+
+    -- test that throws an error if arguments are invalid
+    local err = assert.throws(m.export, m, -1)
+    assert.match(err, 'fd value range')
+    err = assert.throws(evm.import, -1)
+    assert.match(err, 'fd value range')
+end
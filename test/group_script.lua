@@ -0,0 +1,22 @@
+-- script of the loop thread for group_test.lua
+local evm = require('evm')
+local llsocket = require('llsocket')
+local idx, inbox = ...
+
+local m = assert(evm.new())
+local ev = m:newevent()
+assert(ev:ashandoff(inbox))
+
+while true do
+    assert(m:wait())
+    local _, _, _, fds, closed = m:getevent()
+    -- reply thread index to handed off socket
+    for _, fd in ipairs(fds or {}) do
+        local sock = assert(llsocket.socket.wrap(fd))
+        assert(sock:send(tostring(idx)))
+        sock:close()
+    end
+    if closed then
+        return
+    end
+end
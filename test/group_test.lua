@@ -0,0 +1,59 @@
+local testcase = require('testcase')
+local llsocket = require('llsocket')
+local evm = require('evm')
+
+local SCRIPT = debug.getinfo(1, 'S').source:match('^@(.*/)') ..
+                   'group_script.lua'
+
+function testcase.group()
+    -- test that create a group of loop threads
+    local group = assert(evm.group(2, SCRIPT))
+    assert.match(group, '^evm.group: ', false)
+    local stats = group:stats()
+    assert.equal(#stats, 2)
+
+    -- test that hand off descriptors to the specified thread
+    -- the ownership of the descriptor is released from the socket object
+    local socks = {}
+    for i = 1, 2 do
+        local pair = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+        socks[i] = pair
+        assert.equal(group:send(pair[2]:unwrap(), i), i)
+    end
+    for i = 1, 2 do
+        local msg = assert(socks[i][1]:recv())
+        assert.equal(msg, tostring(i))
+    end
+
+    -- test that hand off descriptor to the least-loaded thread
+    local pair = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+    local idx = assert(group:send(pair[2]:unwrap()))
+    assert.equal(assert(pair[1]:recv()), tostring(idx))
+
+    -- test that loop threads exit when the group is closed
+    group:close()
+    assert.is_nil(group:join())
+    -- the ownership of the descriptor is kept if failed
+    pair = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+    local _, err = group:send(pair[2]:fd())
+    assert.match(err, 'EPIPE')
+    pair[1]:close()
+    pair[2]:close()
+end
+
+function testcase.group_script_error()
+    -- test that join returns the error messages of scripts
+    local group = assert(evm.group(1, '/non-existent-script.lua'))
+    local errs = assert(group:join())
+    assert.match(errs[1], 'non-existent-script')
+end
+
+function testcase.group_invalid_arguments()
+    -- test that throws an error if arguments are invalid
+    local err = assert.throws(evm.group, 0, SCRIPT)
+    assert.match(err, 'nthreads value range')
+    err = assert.throws(evm.group, 1, SCRIPT, {
+        'foo',
+    })
+    assert.match(err, 'cpus must be a list of cpu numbers')
+end
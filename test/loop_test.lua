@@ -0,0 +1,149 @@
+local testcase = require('testcase')
+local llsocket = require('llsocket')
+local evm = require('evm')
+
+function testcase.asloop()
+    local m = assert(evm.new())
+    local child = assert(evm.new())
+    local ev = m:newevent()
+    local ctx = {
+        'foo/bar',
+    }
+
+    -- test that event use as a loop event
+    assert(ev:asloop(child, ctx))
+    assert.match(ev, '^evm.loop: ', false)
+    assert.equal(ev:asa(), 'asloop')
+    assert.equal(ev:context(), ctx)
+
+    -- test that no event occurs if child has no events
+    local socks = {}
+    local evs = {}
+    for i = 1, 3 do
+        socks[i] = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+        evs[i] = child:newevent()
+        assert(evs[i]:asreadable(socks[i][1]:fd(), nil, true))
+    end
+    assert.equal(m:wait(5), 0)
+
+    -- test that event occurs and child events are collected
+    for i = 1, 3 do
+        assert(socks[i][2]:send('hello'))
+    end
+    assert.equal(m:wait(5), 1)
+    assert.equal({
+        m:getevent(),
+    }, {
+        ev,
+        ctx,
+        false,
+        3,
+    })
+    local n = 0
+    while child:getevent() do
+        n = n + 1
+    end
+    assert.equal(n, 3)
+
+    ev:revert()
+    for i = 1, 3 do
+        evs[i]:revert()
+        socks[i][1]:close()
+        socks[i][2]:close()
+    end
+end
+
+function testcase.asloop_nevt()
+    local m = assert(evm.new())
+    local child = assert(evm.new())
+    local ev = m:newevent()
+    local socks = {}
+    local evs = {}
+    for i = 1, 3 do
+        socks[i] = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+        evs[i] = child:newevent()
+        assert(evs[i]:asreadable(socks[i][1]:fd(), nil, true))
+        assert(socks[i][2]:send('hello'))
+    end
+
+    -- test that up to nevt events of child are collected at once
+    assert(ev:asloop(child, nil, 2))
+    local seen = {}
+    for _, nevt in ipairs({
+        2,
+        1,
+    }) do
+        assert.equal(m:wait(5), 1)
+        assert.equal(select(4, m:getevent()), nevt)
+        for _ = 1, nevt do
+            local cev = assert(child:getevent())
+            assert.is_nil(seen[cev])
+            seen[cev] = true
+        end
+        assert.is_nil(child:getevent())
+    end
+
+    -- test that no event occurs after all events of child are collected
+    assert.equal(m:wait(5), 0)
+
+    -- test that throws an error if arguments are invalid
+    local newev = m:newevent()
+    local err = assert.throws(newev.asloop, newev, m)
+    assert.match(err, 'cannot watch the loop itself')
+    err = assert.throws(newev.asloop, newev, child, nil, -1)
+    assert.match(err, 'nevt value range')
+
+    ev:revert()
+    for i = 1, 3 do
+        evs[i]:revert()
+        socks[i][1]:close()
+        socks[i][2]:close()
+    end
+end
+
+function testcase.asloop_undelivered()
+    local m = assert(evm.new())
+    local child = assert(evm.new())
+    local ev = m:newevent()
+    local socks = {}
+    local evs = {}
+    for i = 1, 3 do
+        socks[i] = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+        evs[i] = child:newevent()
+        assert(evs[i]:asreadable(socks[i][1]:fd(), nil, false, true))
+    end
+    assert(ev:asloop(child))
+    local nhook = 0
+    assert(child:hook('prepare', function()
+        nhook = nhook + 1
+    end))
+
+    -- test that leave an event of child undelivered
+    for i = 1, 2 do
+        assert(socks[i][2]:send('hello'))
+    end
+    assert.equal(m:wait(5), 1)
+    assert.equal(select(4, m:getevent()), 2)
+    local seen = {}
+    seen[assert(child:getevent())] = true
+
+    -- test that the undelivered event is kept and delivered first
+    assert(socks[3][2]:send('hello'))
+    assert.equal(m:wait(5), 1)
+    assert.equal(select(4, m:getevent()), 2)
+    local cev = assert(child:getevent())
+    assert.is_nil(seen[cev])
+    assert.not_equal(cev, evs[3])
+    assert.equal(child:getevent(), evs[3])
+    assert.is_nil(child:getevent())
+
+    -- test that the hooks of child are not run
+    assert.equal(nhook, 0)
+
+    ev:revert()
+    for i = 1, 3 do
+        evs[i]:revert()
+        socks[i][1]:close()
+        socks[i][2]:close()
+    end
+end
@@ -0,0 +1,184 @@
+local testcase = require('testcase')
+local evm = require('evm')
+local fileno = require('io.fileno')
+
+local function wait_job(m)
+    assert.equal(m:wait(1000), 1)
+    return m:getevent()
+end
+
+function testcase.pool()
+    -- test that create a pool
+    local pool = assert(evm.pool(2, 16))
+    assert.match(pool, '^evm.pool: ', false)
+    local stats = pool:stats()
+    assert.equal(stats.nthreads, 2)
+    assert.equal(stats.qdepth, 16)
+    assert.equal(stats.submitted, 0)
+    assert.equal(stats.saturated, 0)
+
+    -- test that throws an error if arguments are invalid
+    local err = assert.throws(evm.pool, 0)
+    assert.match(err, 'nthreads value range')
+    err = assert.throws(evm.pool, 1, 0)
+    assert.match(err, 'qdepth value range')
+end
+
+function testcase.asfilewrite_asfileread()
+    local m = assert(evm.new())
+    local pool = assert(evm.pool())
+    local f = assert(io.tmpfile())
+    local fd = fileno(f)
+    local ev = m:newevent()
+    local ctx = {}
+
+    -- test that write data to file on the worker thread
+    assert(ev:asfilewrite(pool, fd, 'hello world', 0, ctx))
+    assert.match(ev, '^evm.job: ', false)
+    assert.equal(ev:ident(), fd)
+    assert.equal(ev:asa(), 'asfilewrite')
+    assert.equal(#m, 1)
+    local rev, rctx, disabled, n = wait_job(m)
+    assert.equal(rev, ev)
+    assert.equal(rctx, ctx)
+    assert.is_true(disabled)
+    assert.equal(n, 11)
+    assert.equal(#m, 0)
+
+    -- test that cannot watch completed job
+    local ok, err = ev:watch()
+    assert.is_false(ok)
+    assert(err, 'watch must be failed')
+
+    -- test that read data from file on the worker thread
+    ev = ev:revert()
+    assert(ev:asfileread(pool, fd, 5, 6))
+    assert.equal(ev:asa(), 'asfileread')
+    local data
+    rev, _, disabled, data = wait_job(m)
+    assert.equal(rev, ev)
+    assert.equal(data, 'world')
+
+    -- test that fsync on the worker thread
+    ev = ev:revert()
+    assert(ev:asfsync(pool, fd))
+    assert.equal(ev:asa(), 'asfsync')
+    rev, _, disabled, ok = wait_job(m)
+    assert.equal(rev, ev)
+    assert.is_true(ok)
+
+    -- test that return error of the job
+    ev = ev:revert()
+    assert(ev:asfsync(pool, 12345))
+    rev, _, _, ok, err = wait_job(m)
+    assert.equal(rev, ev)
+    assert.is_nil(ok)
+    assert.match(err, 'EBADF')
+
+    f:close()
+    local stats = pool:stats()
+    assert.equal(stats.submitted, 4)
+    assert.equal(stats.completed, 4)
+end
+
+function testcase.asgetaddrinfo()
+    local m = assert(evm.new())
+    local pool = assert(evm.pool(1))
+    local ev = m:newevent()
+
+    -- test that resolve host name on the worker thread
+    assert(ev:asgetaddrinfo(pool, 'localhost'))
+    assert.equal(ev:ident(), 'localhost')
+    assert.equal(ev:asa(), 'asgetaddrinfo')
+    local rev, _, disabled, addrs = wait_job(m)
+    assert.equal(rev, ev)
+    assert.is_true(disabled)
+    assert.greater(#addrs, 0)
+end
+
+function testcase.saturated()
+    local m = assert(evm.new())
+    local pool = assert(evm.pool(1, 1))
+    local evs = m:newevents(8)
+
+    -- test that returns EAGAIN if the queue is full
+    local nfail = 0
+    for i = 1, 8 do
+        local ok, err = evs[i]:asgetaddrinfo(pool, 'localhost')
+        if not ok then
+            assert.match(err, 'EAGAIN')
+            nfail = nfail + 1
+        end
+    end
+    assert.greater(nfail, 0)
+    assert.equal(pool:stats().saturated, nfail)
+
+    -- test that all submitted jobs are completed
+    local nrecv = 0
+    while nrecv < 8 - nfail do
+        m:wait(1000)
+        while m:getevent() do
+            nrecv = nrecv + 1
+        end
+    end
+    assert.equal(#m, 0)
+end
+
+function testcase.gc_cancel()
+    local m = assert(evm.new())
+    local pool = assert(evm.pool(1, 8))
+    local evs = m:newevents(8)
+    for i = 1, 8 do
+        assert(evs[i]:asgetaddrinfo(pool, 'localhost'))
+    end
+
+    -- test that queued jobs are cancelled by the garbage collector of the pool
+    pool = nil
+    collectgarbage()
+    collectgarbage()
+    local nrecv = 0
+    local ncancel = 0
+    while nrecv < 8 do
+        m:wait(1000)
+        local ev, _, _, _, err = m:getevent()
+        while ev do
+            nrecv = nrecv + 1
+            if err then
+                assert.match(err, 'ECANCELED')
+                ncancel = ncancel + 1
+            end
+            ev, _, _, _, err = m:getevent()
+        end
+    end
+    assert.greater(ncancel, 0)
+    assert.equal(#m, 0)
+end
+
+function testcase.budget_carry()
+    local m = assert(evm.new())
+    local pool = assert(evm.pool(1))
+    local f = assert(io.tmpfile())
+    local fd = fileno(f)
+    local evs = m:newevents(3)
+    for i = 1, 3 do
+        assert(evs[i]:asfsync(pool, fd))
+    end
+    os.execute('sleep 0.05')
+
+    -- test that completed jobs exceeding the budget are carried over
+    assert(m:budget(1))
+    assert.equal(m:wait(1000), 1)
+    local delivered = {}
+    delivered[assert(m:getevent())] = true
+    assert.is_nil(m:getevent())
+    assert.equal(m:wait(0), 2)
+    assert(m:budget(0))
+    for _ = 1, 2 do
+        local ev = assert(m:getevent())
+        assert.is_nil(delivered[ev])
+        delivered[ev] = true
+    end
+    assert.is_nil(m:getevent())
+    assert.equal(#m, 0)
+    f:close()
+end
@@ -0,0 +1,64 @@
+local testcase = require('testcase')
+local evm = require('evm')
+local fork = require('fork')
+local signal = require('signal')
+
+function testcase.asproc()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+    local ctx = {
+        'foo/bar',
+    }
+    local p = assert(fork())
+    if p:is_child() then
+        os.exit(3)
+    end
+
+    -- test that event use as a process event
+    assert(ev:asproc(p:pid(), ctx))
+    assert.match(ev, '^evm.proc: ', false)
+    assert.equal(ev:ident(), p:pid())
+    assert.equal(ev:asa(), 'asproc')
+    assert.equal(ev:context(), ctx)
+
+    -- test that event occurs with exit status when process exited
+    local n, err = m:wait(1000)
+    assert.equal(n, 1)
+    assert.is_nil(err)
+    local rev, rctx, disabled, code, signo = m:getevent()
+    assert.equal(rev, ev)
+    assert.equal(rctx, ctx)
+    assert.is_true(disabled)
+    assert.equal(code, 3)
+    assert.is_nil(signo)
+    assert.equal(#m, 0)
+
+    -- test that throws an error if pid is invalid
+    ev = ev:revert()
+    err = assert.throws(ev.asproc, ev, 0)
+    assert.match(err, 'pid must be greater than 0')
+end
+
+function testcase.asproc_signaled()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+    local p = assert(fork())
+    if p:is_child() then
+        while true do
+        end
+    end
+    assert(ev:asproc(p:pid(), nil, true))
+
+    -- test that event occurs with signal number when process was killed
+    assert(signal.kill(signal.SIGKILL, p:pid()))
+    local n, err = m:wait(1000)
+    assert.equal(n, 1)
+    assert.is_nil(err)
+    local rev, _, disabled, code, signo = m:getevent()
+    assert.equal(rev, ev)
+    assert.is_true(disabled)
+    assert.is_nil(code)
+    assert.equal(signo, signal.SIGKILL)
+
+    ev:revert()
+end
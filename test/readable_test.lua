@@ -11,6 +11,25 @@ function testcase.before_all()
     SOCK1, SOCK2 = pair[1], pair[2]
 end
 
+-- connected TCP sockets over the loopback. the low-water mark of the unix
+-- domain sockets is ignored by linux
+local function tcppair()
+    local ai = assert(llsocket.addrinfo.inet('127.0.0.1', 0,
+                                             llsocket.SOCK_STREAM,
+                                             llsocket.IPPROTO_TCP,
+                                             llsocket.AI_PASSIVE))
+    local server = assert(llsocket.socket.new(ai:family(), ai:socktype(),
+                                              ai:protocol()))
+    assert(server:bind(ai))
+    assert(server:listen())
+    local client = assert(llsocket.socket.new(ai:family(), ai:socktype(),
+                                              ai:protocol()))
+    assert(client:connect(assert(server:getsockname())))
+    local peer = assert(server:accept())
+    server:close()
+    return client, peer
+end
+
 function testcase.asreadable()
     local m = assert(evm.new())
     local ev = m:newevent()
@@ -119,3 +138,127 @@ function testcase.asreadable_edge_trigger()
     ev:revert()
 end
 
+function testcase.revents()
+    local m = assert(evm.new())
+    local pair = assert(llsocket.socket.pair(llsocket.SOCK_STREAM))
+    local ev = m:newevent()
+    assert(ev:asreadable(pair[1]:fd()))
+
+    -- test that returns 0 if no event has occurred
+    assert.equal(ev:revents(), 0)
+
+    -- test that returns the readiness of the occurred event
+    assert(pair[2]:send('hello'))
+    assert.equal(m:wait(5), 1)
+    assert.equal(m:getevent(), ev)
+    local rev, nbytes, err = ev:revents()
+    assert.equal(rev, evm.REV_READ)
+    if nbytes then
+        assert.equal(nbytes, 5)
+    end
+    assert.is_nil(err)
+    assert.equal(pair[1]:recv(), 'hello')
+
+    -- test that returns REV_HUP if peer has closed the connection
+    pair[2]:close()
+    assert.equal(m:wait(5), 1)
+    assert.equal(m:getevent(), ev)
+    rev = ev:revents()
+    assert.equal(rev, evm.REV_READ + evm.REV_HUP)
+end
+
+function testcase.lowat()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+
+    -- test that set the low-water mark
+    assert(ev:asreadable(SOCK1:fd(), nil, nil, nil, 8))
+    assert(ev:lowat(1))
+    assert(ev:lowat(0))
+
+    -- test that throws an error if lowat is invalid
+    local err = assert.throws(ev.lowat, ev, -1)
+    assert.match(err, 'lowat value range must be 0 to')
+    ev:revert()
+    err = assert.throws(ev.asreadable, ev, SOCK1:fd(), nil, nil, nil, -1)
+    assert.match(err, 'lowat value range must be 0 to')
+end
+
+function testcase.lowat_tcp()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+    local client, peer = tcppair()
+
+    -- test that no event occurs until the number of bytes reaches lowat
+    assert(ev:asreadable(peer:fd(), nil, nil, nil, 8))
+    assert(client:send('hello'))
+    assert.equal(m:wait(10), 0)
+    assert(client:send('world'))
+    assert.equal(m:wait(10), 1)
+    assert.equal(m:getevent(), ev)
+
+    ev:revert()
+    client:close()
+    peer:close()
+end
+
+function testcase.deadline()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+    local ctx = {}
+
+    -- test that event is delivered with timedout if fd is not ready in time
+    assert(ev:asreadable(SOCK1:fd(), ctx, nil, nil, nil, 10))
+    local n, err = m:wait(100)
+    assert.equal(n, 1)
+    assert.is_nil(err)
+    local oev, octx, disabled, timedout = m:getevent()
+    assert.equal(oev, ev)
+    assert.equal(octx, ctx)
+    assert.is_false(disabled)
+    assert.is_true(timedout)
+    assert.is_nil(m:getevent())
+    assert.equal(m:stats().ntimedout, 1)
+
+    -- test that deadline is one-shot
+    n = m:wait(20)
+    assert.equal(n, 0)
+
+    -- test that deadline is cancelled if fd becomes ready in time
+    assert(ev:deadline(10))
+    assert(SOCK2:send('hello'))
+    n = m:wait(100)
+    assert.equal(n, 1)
+    oev, _, _, timedout = m:getevent()
+    assert.equal(oev, ev)
+    assert.is_nil(timedout)
+    assert.equal(SOCK1:read(), 'hello')
+    n = m:wait(20)
+    assert.equal(n, 0)
+
+    -- test that deadline can be cancelled
+    assert(ev:deadline(10))
+    assert(ev:deadline())
+    n = m:wait(20)
+    assert.equal(n, 0)
+
+    -- test that deadline is cancelled by unwatch
+    assert(ev:deadline(10))
+    ev:unwatch()
+    assert.equal(#m, 0)
+    ev:watch()
+    n = m:wait(20)
+    assert.equal(n, 0)
+
+    -- test that fails if the event is not registered
+    ev:unwatch()
+    local ok
+    ok, err = ev:deadline(10)
+    assert.is_false(ok)
+    assert.match(err, 'ENOENT')
+
+    -- test that throws an error if deadline is invalid
+    err = assert.throws(ev.deadline, ev, 0)
+    assert.match(err, 'deadline must be greater than 0')
+    ev:revert()
+end
@@ -68,3 +68,174 @@ function testcase.astimer_oneshot()
     ev:revert()
 end
 
+function testcase.astimer_slack()
+    local m = assert(evm.new(nil, {
+        slack = 100,
+    }))
+    local ev1 = m:newevent()
+    local ev2 = m:newevent()
+
+    -- wait until just after the boundary of the 100 msec slack window, so
+    -- that both expirations fall in the same window
+    repeat
+        m:wait(1)
+        m:update_now()
+    until (m:now() * 1000) % 100 < 20
+
+    -- test that timers within the same slack window expire at once
+    assert(ev1:astimer(10, nil, true))
+    assert(ev2:astimer(30, nil, true))
+    local n, err = m:wait(200)
+    assert.equal(n, 2)
+    assert.is_nil(err)
+    assert(m:getevent())
+    assert(m:getevent())
+    assert.is_nil(m:getevent())
+    assert.equal(m:stats().ncoalesced, 1)
+
+    -- test that slack and jitter can be specified for each timer
+    assert(ev1:astimer(10, nil, false, 5, true))
+    assert.equal(ev1:ident(), 10)
+    ev1:revert()
+    ev2:revert()
+
+    -- test that throws an error if slack is invalid
+    local ev = m:newevent()
+    err = assert.throws(ev.astimer, ev, 10, nil, nil, -1)
+    assert.match(err, 'slack value range')
+    err = assert.throws(evm.new, nil, {
+        slack = -1,
+    })
+    assert.match(err, 'opts.slack value range')
+end
+
+function testcase.reset()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+    assert(ev:astimer(30))
+
+    -- test that reset re-arms the timer with the new timeout
+    assert(ev:reset(10))
+    assert.equal(ev:ident(), 10)
+    local n, err = m:wait(20)
+    assert.equal(n, 1)
+    assert.is_nil(err)
+    local ev2, _, disabled, nexp = m:getevent()
+    assert.equal(ev2, ev)
+    assert.is_false(disabled)
+    assert.equal(nexp, 1)
+
+    -- test that reset postpones the expiration
+    assert(ev:reset())
+    assert.equal(ev:ident(), 10)
+    n = m:wait(5)
+    assert.equal(n, 0)
+    assert(ev:reset())
+    n = m:wait(20)
+    assert.equal(n, 1)
+    assert.equal(m:getevent(), ev)
+
+    -- test that expirations are accumulated if not delivered
+    m:update_now()
+    assert(ev:reset())
+    os.execute('sleep 0.035')
+    n = m:wait(0)
+    assert.equal(n, 1)
+    _, _, _, nexp = m:getevent()
+    assert.greater_or_equal(nexp, 3)
+
+    -- test that pending expiration is dropped by reset
+    os.execute('sleep 0.015')
+    m:update_now()
+    n = m:wait(0)
+    assert.equal(n, 1)
+    assert(ev:reset(50))
+    assert.is_nil(m:getevent())
+
+    -- test that reset registers the one-shot timer again
+    ev:revert()
+    ev = m:newevent()
+    assert(ev:astimer(10, nil, true))
+    n = m:wait(20)
+    assert.equal(n, 1)
+    assert.equal(m:getevent(), ev)
+    assert.equal(#m, 0)
+    assert(ev:reset())
+    assert.equal(#m, 1)
+    n = m:wait(20)
+    assert.equal(n, 1)
+    assert.equal(m:getevent(), ev)
+
+    -- test that throws an error if timeout is invalid
+    err = assert.throws(ev.reset, ev, 0)
+    assert.match(err, 'timeout must be greater than 0')
+    ev:revert()
+end
+
+function testcase.astimer_submsec()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+
+    -- test that timeout can be specified in fractional milliseconds
+    assert(ev:astimer(0.5))
+    assert.equal(ev:ident(), 0.5)
+    local n, err = m:wait(5)
+    assert.equal(n, 1)
+    assert.is_nil(err)
+    assert.equal(m:getevent(), ev)
+    ev:revert()
+
+    -- test that wait accepts fractional milliseconds
+    ev = m:newevent()
+    assert(ev:astimer(1000))
+    n, err = m:wait(0.5)
+    assert.equal(n, 0)
+    assert.is_nil(err)
+    ev:revert()
+
+    -- test that throws an error if timeout is less than 1 nsec
+    ev = m:newevent()
+    err = assert.throws(ev.astimer, ev, 0.0000001)
+    assert.match(err, 'timeout must be greater than 0')
+end
+
+function testcase.asdeadline()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+    local ctx = {}
+
+    -- test that event occurs at the absolute deadline
+    local deadline = m:update_now() + 0.01
+    assert(ev:asdeadline(deadline, ctx))
+    assert.match(ev, '^evm.timer: ', false)
+    assert.equal(ev:asa(), 'astimer')
+    assert.equal(ev:context(), ctx)
+    -- test that ident returns the time until the deadline
+    assert.greater(ev:ident(), 0)
+    assert.greater_or_equal(10, ev:ident())
+    local n, err = m:wait(50)
+    assert.equal(n, 1)
+    assert.is_nil(err)
+    local oev, octx, disabled = m:getevent()
+    assert.equal(oev, ev)
+    assert.equal(octx, ctx)
+    assert.is_true(disabled)
+    assert.greater_or_equal(m:update_now(), deadline)
+
+    -- test that reset moves the deadline
+    assert(ev:reset(10))
+    assert.equal(m:wait(50), 1)
+    assert.equal(m:getevent(), ev)
+
+    -- test that event occurs immediately if deadline has passed
+    ev = m:newevent()
+    assert(ev:asdeadline(m:now() - 1))
+    n = m:wait(10)
+    assert.equal(n, 1)
+    assert.equal(m:getevent(), ev)
+
+    -- test that throws an error if deadline is invalid
+    ev = m:newevent()
+    err = assert.throws(ev.asdeadline, ev, 0)
+    assert.match(err, 'deadline must be greater than 0')
+end
@@ -0,0 +1,90 @@
+local testcase = require('testcase')
+local evm = require('evm')
+
+local function tmpdir()
+    local dir = os.tmpname()
+    os.remove(dir)
+    assert(os.execute('mkdir ' .. dir))
+    return dir
+end
+
+function testcase.aswatchpath()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+    local ctx = {
+        'foo/bar',
+    }
+    local dir = tmpdir()
+
+    -- test that event use as a path event
+    assert(ev:aswatchpath(dir, evm.WATCH_CREATE, ctx))
+    assert.match(ev, '^evm.watchpath: ', false)
+    assert.equal(ev:ident(), dir)
+    assert.equal(ev:asa(), 'aswatchpath')
+    assert.equal(ev:context(), ctx)
+    assert.equal(#m, 1)
+
+    -- test that event occurs when file is created in the directory
+    local f = assert(io.open(dir .. '/hello', 'w'))
+    f:close()
+    local n, err = m:wait(1000)
+    assert.equal(n, 1)
+    assert.is_nil(err)
+    local rev, rctx, disabled, mask = m:getevent()
+    assert.equal(rev, ev)
+    assert.equal(rctx, ctx)
+    assert.is_false(disabled)
+    assert.equal(mask, evm.WATCH_CREATE)
+
+    -- test that unwatch and watch the path
+    ev:unwatch()
+    assert.equal(#m, 0)
+    assert(ev:watch())
+    assert.equal(#m, 1)
+
+    -- test that event is disabled when the watched path is deleted
+    ev = ev:revert()
+    assert(ev:aswatchpath(dir, evm.WATCH_DELETE_SELF))
+    os.remove(dir .. '/hello')
+    os.remove(dir)
+    n = assert(m:wait(1000))
+    assert.greater(n, 0)
+    rev, _, disabled = m:getevent()
+    assert.equal(rev, ev)
+    assert.is_true(disabled)
+    assert.equal(#m, 0)
+end
+
+function testcase.aswatchpath_oneshot()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+    local dir = tmpdir()
+
+    -- test that oneshot event is disabled after event occurred
+    assert(ev:aswatchpath(dir, nil, nil, true))
+    local f = assert(io.open(dir .. '/hello', 'w'))
+    f:close()
+    assert.equal(m:wait(1000), 1)
+    local rev, _, disabled = m:getevent()
+    assert.equal(rev, ev)
+    assert.is_true(disabled)
+    assert.equal(#m, 0)
+
+    os.remove(dir .. '/hello')
+    os.remove(dir)
+end
+
+function testcase.aswatchpath_invalid_arguments()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+
+    -- test that throws an error if mask is invalid
+    local err = assert.throws(ev.aswatchpath, ev, '/tmp', 0)
+    assert.match(err, 'mask must be a combination of')
+
+    -- test that returns an error if path does not exist
+    local ok
+    ok, err = ev:aswatchpath('/non-existent-path/foo')
+    assert.is_false(ok)
+    assert.match(err, 'aswatchpath')
+end
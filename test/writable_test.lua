@@ -11,6 +11,28 @@ function testcase.before_all()
     SOCK1, SOCK2 = pair[1], pair[2]
 end
 
+-- connected TCP sockets over the loopback. the low-water mark of the unix
+-- domain sockets is ignored by linux
+local function tcppair(nonblock)
+    local ai = assert(llsocket.addrinfo.inet('127.0.0.1', 0,
+                                             llsocket.SOCK_STREAM,
+                                             llsocket.IPPROTO_TCP,
+                                             llsocket.AI_PASSIVE))
+    local server = assert(llsocket.socket.new(ai:family(), ai:socktype(),
+                                              ai:protocol()))
+    assert(server:bind(ai))
+    assert(server:listen())
+    local client = assert(llsocket.socket.new(ai:family(), ai:socktype(),
+                                              ai:protocol()))
+    assert(client:connect(assert(server:getsockname())))
+    local peer = assert(server:accept())
+    server:close()
+    if nonblock then
+        client:nonblock(true)
+    end
+    return client, peer
+end
+
 function testcase.aswritable()
     local m = assert(evm.new())
     local ev = m:newevent()
@@ -123,3 +145,31 @@ function testcase.aswritable_edge_trigger()
     ev:revert()
 end
 
+function testcase.lowat_tcp()
+    local m = assert(evm.new())
+    local ev = m:newevent()
+    local client, peer = tcppair(true)
+    assert(client:sndbuf(4096))
+    assert(peer:rcvbuf(4096))
+    assert(ev:aswritable(client:fd(), nil, nil, nil, 1024))
+
+    -- test that no event occurs while the send buffer is full
+    local data = string.rep('x', 4096)
+    repeat
+        local _, _, again = assert(client:send(data))
+    until again
+    assert.equal(m:wait(10), 0)
+
+    -- test that event occurs after the peer drains the data
+    local n
+    repeat
+        assert(peer:recv(65536))
+        n = m:wait(10)
+    until n > 0
+    assert.equal(n, 1)
+    assert.equal(m:getevent(), ev)
+
+    ev:revert()
+    client:close()
+    peer:close()
+end